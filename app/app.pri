@@ -62,6 +62,7 @@ SOURCES += \
 	$${PWD}/logtextedit.cpp \
 	$${PWD}/main.cpp \
 	$${PWD}/mainwindow.cpp \
+	$${PWD}/tikzbatchrenderer.cpp \
 	$${PWD}/tikzcommandinserter.cpp \
 	$${PWD}/tikzcommandwidget.cpp \
 	$${PWD}/tikzdocumentationcontroller.cpp \
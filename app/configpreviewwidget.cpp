@@ -20,9 +20,15 @@
 
 #include <QtCore/QSettings>
 
+#include "../common/tikzcompilecache.h"
+#include "../common/tikzgnuplotcache.h"
+
 ConfigPreviewWidget::ConfigPreviewWidget(QWidget *parent) : QWidget(parent)
 {
     ui.setupUi(this);
+
+    connect(ui.clearCompileCacheButton, &QPushButton::clicked, this,
+            &ConfigPreviewWidget::clearCompileCache);
 }
 
 ConfigPreviewWidget::~ConfigPreviewWidget() { }
@@ -35,6 +41,10 @@ void ConfigPreviewWidget::readSettings(const QString &settingsGroup)
         ui.buildAutomaticallyRadio->setChecked(true);
     else
         ui.buildManuallyRadio->setChecked(true);
+    ui.minUpdateIntervalSpinBox->setValue(
+            settings.value(QLatin1String("MinimumUpdateInterval"), 250).toInt());
+    ui.maxUpdateIntervalSpinBox->setValue(
+            settings.value(QLatin1String("MaximumUpdateInterval"), 5000).toInt());
 
     ui.showCoordinatesCheck->setChecked(
             settings.value(QLatin1String("ShowCoordinates"), true).toBool());
@@ -47,7 +57,34 @@ void ConfigPreviewWidget::readSettings(const QString &settingsGroup)
     }
     ui.backgroundColorButton->setColor(
             settings.value(QLatin1String("PreviewBackgroundColor")).value<QColor>());
+    ui.usePreambleFormatCheck->setChecked(
+            settings.value(QLatin1String("UsePreambleFormat"), true).toBool());
+    ui.useResidentWorkerCheck->setChecked(
+            settings.value(QLatin1String("UseResidentWorker"), false).toBool());
+    ui.incrementalCompilationCheck->setChecked(
+            settings.value(QLatin1String("IncrementalCompilation"), false).toBool());
+    ui.useCompileCacheCheck->setChecked(
+            settings.value(QLatin1String("UseCompileCache"), true).toBool());
+    ui.compileCacheSizeSpinBox->setValue(
+            settings.value(QLatin1String("CompileCacheSize"), 100).toInt());
+    ui.useMemoryWorkspaceCheck->setChecked(
+            settings.value(QLatin1String("UseMemoryWorkspace"), false).toBool());
+    ui.abortOnFirstErrorCheck->setChecked(
+            settings.value(QLatin1String("AbortOnFirstError"), false).toBool());
+    ui.maxConcurrentCompilationsSpinBox->setValue(
+            settings.value(QLatin1String("MaximumConcurrentCompilations"), 0).toInt());
+    ui.letCompilationFinishCheck->setChecked(
+            settings.value(QLatin1String("LetCompilationFinish"), true).toBool());
+    ui.letCompilationFinishSpinBox->setValue(
+            settings.value(QLatin1String("LetCompilationFinishPercentage"), 50).toInt());
+    ui.cpuTimeLimitSpinBox->setValue(settings.value(QLatin1String("CpuTimeLimit"), 0).toInt());
+    ui.memoryLimitSpinBox->setValue(settings.value(QLatin1String("MemoryLimit"), 0).toInt());
+    ui.timeLimitSpinBox->setValue(settings.value(QLatin1String("TimeLimit"), 0).toInt());
+    ui.draftPreCheckCheck->setChecked(
+            settings.value(QLatin1String("DraftPreCheck"), false).toBool());
     settings.endGroup();
+
+    updateCompileCacheStatus();
 }
 
 void ConfigPreviewWidget::writeSettings(const QString &settingsGroup)
@@ -55,6 +92,10 @@ void ConfigPreviewWidget::writeSettings(const QString &settingsGroup)
     QSettings settings;
     settings.beginGroup(settingsGroup);
     settings.setValue(QLatin1String("BuildAutomatically"), ui.buildAutomaticallyRadio->isChecked());
+    settings.setValue(QLatin1String("MinimumUpdateInterval"), ui.minUpdateIntervalSpinBox->value());
+    settings.setValue(QLatin1String("MaximumUpdateInterval"),
+                      qMax(ui.minUpdateIntervalSpinBox->value(),
+                           ui.maxUpdateIntervalSpinBox->value()));
     settings.setValue(QLatin1String("ShowCoordinates"), ui.showCoordinatesCheck->isChecked());
     if (ui.bestPrecisionRadio->isChecked())
         settings.setValue(QLatin1String("ShowCoordinatesPrecision"), -1);
@@ -62,5 +103,41 @@ void ConfigPreviewWidget::writeSettings(const QString &settingsGroup)
         settings.setValue(QLatin1String("ShowCoordinatesPrecision"),
                           ui.specifyPrecisionSpinBox->value());
     settings.setValue(QLatin1String("PreviewBackgroundColor"), ui.backgroundColorButton->color());
+    settings.setValue(QLatin1String("UsePreambleFormat"), ui.usePreambleFormatCheck->isChecked());
+    settings.setValue(QLatin1String("UseResidentWorker"), ui.useResidentWorkerCheck->isChecked());
+    settings.setValue(QLatin1String("IncrementalCompilation"),
+                      ui.incrementalCompilationCheck->isChecked());
+    settings.setValue(QLatin1String("UseCompileCache"), ui.useCompileCacheCheck->isChecked());
+    settings.setValue(QLatin1String("CompileCacheSize"), ui.compileCacheSizeSpinBox->value());
+    settings.setValue(QLatin1String("UseMemoryWorkspace"), ui.useMemoryWorkspaceCheck->isChecked());
+    settings.setValue(QLatin1String("AbortOnFirstError"), ui.abortOnFirstErrorCheck->isChecked());
+    settings.setValue(QLatin1String("MaximumConcurrentCompilations"),
+                      ui.maxConcurrentCompilationsSpinBox->value());
+    settings.setValue(QLatin1String("LetCompilationFinish"),
+                      ui.letCompilationFinishCheck->isChecked());
+    settings.setValue(QLatin1String("LetCompilationFinishPercentage"),
+                      ui.letCompilationFinishSpinBox->value());
+    settings.setValue(QLatin1String("CpuTimeLimit"), ui.cpuTimeLimitSpinBox->value());
+    settings.setValue(QLatin1String("MemoryLimit"), ui.memoryLimitSpinBox->value());
+    settings.setValue(QLatin1String("TimeLimit"), ui.timeLimitSpinBox->value());
+    settings.setValue(QLatin1String("DraftPreCheck"), ui.draftPreCheckCheck->isChecked());
     settings.endGroup();
 }
+
+void ConfigPreviewWidget::clearCompileCache()
+{
+    TikzCompileCache::clear();
+    TikzGnuplotCache::clear();
+    updateCompileCacheStatus();
+}
+
+void ConfigPreviewWidget::updateCompileCacheStatus()
+{
+    ui.compileCacheStatusLabel->setText(
+            tr("%1 MiB used, %2 hits, %3 misses")
+                    .arg(QString::number((TikzCompileCache::size() + TikzGnuplotCache::size())
+                                                 / (1024.0 * 1024.0),
+                                         'f', 1))
+                    .arg(TikzCompileCache::hitCount())
+                    .arg(TikzCompileCache::missCount()));
+}
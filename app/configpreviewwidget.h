@@ -32,7 +32,12 @@ public:
     void readSettings(const QString &settingsGroup);
     void writeSettings(const QString &settingsGroup);
 
+protected Q_SLOTS:
+    void clearCompileCache();
+
 protected:
+    void updateCompileCacheStatus();
+
     Ui::ConfigPreviewWidget ui;
 };
 
@@ -20,35 +20,20 @@
 
 #include "loghighlighter.h"
 
+#include "../common/tikzlogscanner.h"
+
 LogHighlighter::LogHighlighter(QTextDocument *parent) : QSyntaxHighlighter(parent)
 {
-    LogHighlightingRule rule;
+    m_keywordFormat.setForeground(Qt::red);
+    m_keywordFormat.setFontWeight(QFont::Bold);
+    // messages created by TikzPreviewGenerator and ktikz itself
+    m_translatedKeywords << tr("Error:") << tr("Warning:") << tr("This program will not work!");
 
-    QTextCharFormat keywordFormat;
-    keywordFormat.setForeground(Qt::red);
-    keywordFormat.setFontWeight(QFont::Bold);
-    QStringList keywordPatterns;
-    keywordPatterns
-            << QLatin1String("\\S*:\\d+:.*$") << QLatin1String("Undefined control sequence")
-            << QLatin1String("LaTeX Warning:") << QLatin1String("LaTeX Error:")
-            << QLatin1String("Runaway argument?") << QLatin1String("Missing character: .*!")
-            << QLatin1String("Error:") << tr("Error:")
-            << tr("Warning:") // error msg created by TikzPreviewGenerator
-            << QLatin1String("^\\[.*\\] Line \\d+: .*") // error msg created by
-                                                        // TikzPreviewGenerator::getParsedLogText()
-            << tr("This program will not work!");
-    for (const auto &pattern : keywordPatterns) {
-        rule.pattern = QRegExp(pattern);
-        rule.format = keywordFormat;
-        m_highlightingRules.append(rule);
-    }
+    m_warningFormat.setForeground(Qt::darkYellow);
+    m_warningFormat.setFontWeight(QFont::Bold);
 
-    QTextCharFormat commandFormat;
-    commandFormat.setForeground(Qt::darkBlue);
-    commandFormat.setFontWeight(QFont::Bold);
-    rule.pattern = QRegExp(QLatin1String("^\\[[^\\]\\d][^\\]]*\\]"));
-    rule.format = commandFormat;
-    m_highlightingRules.append(rule);
+    m_commandFormat.setForeground(Qt::darkBlue);
+    m_commandFormat.setFontWeight(QFont::Bold);
 
     m_statisticsFormat.setForeground(Qt::darkGray);
     //	m_statisticsFormat.setFontPointSize(5.0);
@@ -59,18 +44,25 @@ LogHighlighter::~LogHighlighter() { }
 
 void LogHighlighter::highlightBlock(const QString &text)
 {
-    // Try each highlighting pattern and apply formatting if it matches
-    for (const auto &rule : m_highlightingRules) {
-        // const QRegExp expression(rule.pattern);
-        // int index = text.indexOf(expression);
-        QRegExp expression(rule.pattern);
-        int index = expression.indexIn(text);
-        while (index >= 0) {
-            const int length = expression.matchedLength();
-            setFormat(index, length, rule.format);
-            // index = text.indexOf(expression, index + length);
-            index = expression.indexIn(text, index + length);
-        }
+    // Highlight errors and warnings, these are found in one pass over the text
+    const QVector<TikzLogScanner::Diagnostic> diagnostics = TikzLogScanner::scan(text);
+    for (const auto &diagnostic : diagnostics)
+        setFormat(diagnostic.offset,
+                  diagnostic.messageOffset + diagnostic.messageLength - diagnostic.offset,
+                  diagnostic.severity == TikzLogScanner::Warning ? m_warningFormat
+                                                                 : m_keywordFormat);
+    for (const auto &keyword : qAsConst(m_translatedKeywords)) {
+        const int index = text.indexOf(keyword);
+        if (index >= 0)
+            setFormat(index, keyword.size(), m_keywordFormat);
+    }
+
+    // Highlight the name of the command in messages like "[LaTeX] ..."
+    if (text.size() > 1 && text.at(0) == QLatin1Char('[') && !text.at(1).isDigit()
+        && text.at(1) != QLatin1Char(']')) {
+        const int end = text.indexOf(QLatin1Char(']'));
+        if (end > 0)
+            setFormat(0, end + 1, m_commandFormat);
     }
 
     // Highlight statistics (at the end of the log)
@@ -21,6 +21,7 @@
 #ifndef LOGHIGHLIGHTER_H
 #define LOGHIGHLIGHTER_H
 
+#include <QtCore/QStringList>
 #include <QtGui/QSyntaxHighlighter>
 #include <QtGui/QTextCharFormat>
 
@@ -42,13 +43,14 @@ protected:
     void highlightBlock(const QString &text) override;
 
 private:
-    struct LogHighlightingRule
-    {
-        QRegExp pattern; /// The pattern to match for formatting
-        QTextCharFormat format; /// The style of the formatting
-    };
-    /// All highlighting rules with their formatting for easy iteration
-    QVector<LogHighlightingRule> m_highlightingRules;
+    /// The highlighting format for errors
+    QTextCharFormat m_keywordFormat;
+    /// The highlighting format for warnings found in the LaTeX log
+    QTextCharFormat m_warningFormat;
+    /// Translated error messages which are highlighted as well
+    QStringList m_translatedKeywords;
+    /// The highlighting format for the name of the command in messages by KtikZ
+    QTextCharFormat m_commandFormat;
     /// The start of the statistics output by LaTeX
     QString m_statisticsStartExpression;
     /// The highlighting format for LaTeX statistics
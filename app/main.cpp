@@ -36,6 +36,7 @@
 
 #include "../common/utils/url.h"
 #include "ktikzapplication.h"
+#include "tikzbatchrenderer.h"
 
 // add copyright notice to the *.ts files; this string is not used anywhere else
 static struct
@@ -109,6 +110,103 @@ static void createTranslator(QTranslator *translator, const QString &transName,
     }
 }
 
+/*!
+ * Renders the TikZ files given on the command line without creating any
+ * widgets, e.g. to generate the figures of a report in a build job.
+ */
+
+static int renderFiles(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setOrganizationName(QString::fromLocal8Bit(ORGNAME));
+    QCoreApplication::setApplicationName(QString::fromLocal8Bit(APPNAME));
+    QCoreApplication::setApplicationVersion(QString::fromLocal8Bit(APPVERSION));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+            QCoreApplication::translate("main", "Renders TikZ files without user interface."));
+    parser.addHelpOption();
+    parser.addVersionOption();
+    const QCommandLineOption renderOption(
+            QLatin1String("render"),
+            QCoreApplication::translate("main", "Render the files instead of opening them."));
+    const QCommandLineOption outputDirectoryOption(
+            QStringList() << QLatin1String("o") << QLatin1String("output-directory"),
+            QCoreApplication::translate(
+                    "main", "Write the output files to <directory> instead of next to the files."),
+            QLatin1String("directory"));
+    const QCommandLineOption formatOption(
+            QLatin1String("format"),
+            QCoreApplication::translate(
+                    "main", "Comma-separated list of output formats (pdf, png, eps, svg)."),
+            QLatin1String("formats"), QLatin1String("pdf"));
+    const QCommandLineOption dpiOption(
+            QLatin1String("dpi"),
+            QCoreApplication::translate("main", "Resolution of the PNG files."),
+            QLatin1String("dpi"), QLatin1String("300"));
+    const QCommandLineOption jobsOption(
+            QStringList() << QLatin1String("j") << QLatin1String("jobs"),
+            QCoreApplication::translate("main",
+                                        "Number of files compiled at the same time (default: "
+                                        "the number of processor cores)."),
+            QLatin1String("count"), QLatin1String("0"));
+    const QCommandLineOption templateOption(
+            QLatin1String("template"),
+            QCoreApplication::translate("main",
+                                        "Use <file> as template instead of the configured one."),
+            QLatin1String("file"));
+    const QCommandLineOption summaryOption(
+            QLatin1String("summary"),
+            QCoreApplication::translate(
+                    "main", "Write the JSON summary to <file> instead of standard output."),
+            QLatin1String("file"));
+    parser.addOption(renderOption);
+    parser.addOption(outputDirectoryOption);
+    parser.addOption(formatOption);
+    parser.addOption(dpiOption);
+    parser.addOption(jobsOption);
+    parser.addOption(templateOption);
+    parser.addOption(summaryOption);
+    parser.addPositionalArgument(QLatin1String("files"),
+                                 QCoreApplication::translate("main", "TikZ files to render."),
+                                 QLatin1String("files..."));
+    parser.process(app);
+    if (parser.positionalArguments().isEmpty())
+        parser.showHelp(2);
+
+    TikzBatchRenderer::Formats formats;
+    const QStringList formatNames =
+            parser.value(formatOption).toLower().split(QLatin1Char(','), Qt::SkipEmptyParts);
+    for (const auto &formatName : formatNames) {
+        if (formatName == QLatin1String("pdf"))
+            formats |= TikzBatchRenderer::Pdf;
+        else if (formatName == QLatin1String("png"))
+            formats |= TikzBatchRenderer::Png;
+        else if (formatName == QLatin1String("eps"))
+            formats |= TikzBatchRenderer::Eps;
+        else if (formatName == QLatin1String("svg"))
+            formats |= TikzBatchRenderer::Svg;
+        else {
+            fprintf(stderr, "%s\n",
+                    qPrintable(QCoreApplication::translate("main", "Unknown output format: %1")
+                                       .arg(formatName)));
+            return 2;
+        }
+    }
+    const int dpi = parser.value(dpiOption).toInt();
+    if (!formats || dpi <= 0)
+        parser.showHelp(2);
+
+    TikzBatchRenderer renderer;
+    renderer.setOutputDirectory(parser.value(outputDirectoryOption));
+    renderer.setFormats(formats);
+    renderer.setResolution(dpi);
+    renderer.setMaximumJobCount(parser.value(jobsOption).toInt());
+    renderer.setTemplateFile(parser.value(templateOption));
+    renderer.setSummaryFile(parser.value(summaryOption));
+    return renderer.render(parser.positionalArguments());
+}
+
 int main(int argc, char **argv)
 {
     // QTime t = QTime::currentTime();
@@ -130,6 +228,10 @@ int main(int argc, char **argv)
     }
 #endif
 
+    for (int i = 1; i < argc; ++i)
+        if (!strcmp(argv[i], "--render"))
+            return renderFiles(argc, argv);
+
 #ifdef KTIKZ_USE_KDE
     Q_INIT_RESOURCE(ktikz);
 #else
@@ -231,6 +231,8 @@ MainWindow::MainWindow()
             });
     connect(m_tikzPreviewController, &TikzPreviewController::showMouseCoordinates, this,
             &MainWindow::showMouseCoordinates);
+    connect(m_tikzPreviewController, &TikzPreviewController::showStatusMessage, statusBar(),
+            &QStatusBar::showMessage);
 
     connect(m_userCommandInserter, &UserCommandInserter::updateCompleter, this,
             &MainWindow::updateCompleter);
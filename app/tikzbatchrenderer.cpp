@@ -0,0 +1,433 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#include "tikzbatchrenderer.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QHash>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QProcess>
+#include <QtCore/QSettings>
+#include <QtCore/QTextStream>
+#include <QtCore/QThread>
+#include <QtCore/QUrl>
+#include <QtGui/QImage>
+#include <poppler-qt5.h>
+
+#include "../common/tikzcompilescheduler.h"
+#include "../common/tikzpreviewgenerator.h"
+#include "../common/tikzprocess.h"
+#include "../common/utils/tempdir.h"
+
+static const char s_tempFileName[] = "/temptikzcode";
+static const int s_defaultTimeLimit = 60; // in seconds, for pdftocairo if no limit is set
+
+TikzBatchRenderer::TikzBatchRenderer(QObject *parent)
+    : QObject(parent),
+      m_formats(Pdf),
+      m_resolution(300),
+      m_maximumJobCount(0),
+      m_cpuTimeLimit(0),
+      m_memoryLimit(0),
+      m_timeLimit(0),
+      m_nextJob(0),
+      m_runningJobCount(0)
+{
+    connect(this, &TikzBatchRenderer::jobFinished, this, &TikzBatchRenderer::finishJob,
+            Qt::QueuedConnection);
+}
+
+TikzBatchRenderer::~TikzBatchRenderer()
+{
+    for (const auto &slot : qAsConst(m_slots)) {
+        delete slot.generator;
+        delete slot.tempDir;
+    }
+}
+
+/*!
+ * Sets the directory in which the output files are written; by default they
+ * are written next to the input files.
+ */
+
+void TikzBatchRenderer::setOutputDirectory(const QString &path)
+{
+    m_outputDirectory = path;
+}
+
+void TikzBatchRenderer::setFormats(Formats formats)
+{
+    m_formats = formats;
+}
+
+/*!
+ * Sets the resolution (in dots per inch) of the PNG files.
+ */
+
+void TikzBatchRenderer::setResolution(int dpi)
+{
+    m_resolution = dpi;
+}
+
+/*!
+ * Sets the number of files which are compiled at the same time; a value of
+ * 0 means the number of processor cores.
+ */
+
+void TikzBatchRenderer::setMaximumJobCount(int count)
+{
+    m_maximumJobCount = count;
+}
+
+/*!
+ * Sets the template used instead of the one in the settings.
+ */
+
+void TikzBatchRenderer::setTemplateFile(const QString &fileName)
+{
+    m_templateFileName = fileName;
+}
+
+/*!
+ * Sets the file to which the JSON summary is written; by default it is
+ * written to standard output.
+ */
+
+void TikzBatchRenderer::setSummaryFile(const QString &fileName)
+{
+    m_summaryFileName = fileName;
+}
+
+/*!
+ * Renders the TikZ files \p fileNames and returns the exit code of the
+ * program: 0 if all files have been rendered, 1 otherwise.
+ */
+
+int TikzBatchRenderer::render(const QStringList &fileNames)
+{
+    m_timer.start();
+    // two files with the same name in different directories would overwrite
+    // each other's output files when they are written to one directory, so
+    // only the first of them is rendered
+    QHash<QString, QString> inputFileNames; // by output base name
+    for (const auto &fileName : fileNames) {
+        const QFileInfo tikzFileInfo(fileName);
+        Job job;
+        job.fileName = fileName;
+        const QString outputDirectory = m_outputDirectory.isEmpty()
+                ? tikzFileInfo.absolutePath()
+                : QDir(m_outputDirectory).absolutePath();
+        job.outputBaseName = QDir::cleanPath(outputDirectory) + QLatin1Char('/')
+                + tikzFileInfo.completeBaseName();
+        job.addedSearchPath = false;
+        job.time = 0;
+        job.latexTime = -1;
+        job.success = false;
+        if (inputFileNames.contains(job.outputBaseName))
+            job.error = tr("The output files would overwrite those of \"%1\".")
+                                .arg(inputFileNames.value(job.outputBaseName));
+        else
+            inputFileNames.insert(job.outputBaseName, fileName);
+        m_jobs << job;
+    }
+
+    const int jobCount = m_maximumJobCount > 0 ? m_maximumJobCount : QThread::idealThreadCount();
+    createGenerators(qMax(1, qMin(jobCount, m_jobs.size())));
+    for (int i = 0; i < m_slots.size(); ++i)
+        startJob(i);
+    if (m_runningJobCount > 0)
+        m_eventLoop.exec();
+
+    int failedCount = 0;
+    for (const auto &job : qAsConst(m_jobs))
+        if (!job.success)
+            ++failedCount;
+    if (!writeSummary())
+        return 1;
+    return failedCount > 0 ? 1 : 0;
+}
+
+void TikzBatchRenderer::createGenerators(int count)
+{
+    QSettings settings(QString::fromLocal8Bit(ORGNAME), QString::fromLocal8Bit(APPNAME));
+    QString templateFileName = m_templateFileName.isEmpty()
+            ? settings.value(QLatin1String("TemplateFile")).toString()
+            : m_templateFileName;
+    templateFileName = QUrl::fromUserInput(templateFileName, QDir::currentPath(),
+                                           QUrl::AssumeLocalFile)
+                               .toLocalFile();
+
+    TikzCompileScheduler::instance()->setMaximumRunningCount(count);
+    for (int i = 0; i < count; ++i) {
+        TikzPreviewGenerator *generator = new TikzPreviewGenerator(0);
+        generator->setLatexCommand(
+                settings.value(QLatin1String("LatexCommand"), QLatin1String("pdflatex"))
+                        .toString());
+        generator->setPdftopsCommand(
+                settings.value(QLatin1String("PdftopsCommand"), QLatin1String("pdftops"))
+                        .toString());
+        generator->setShellEscaping(
+                settings.value(QLatin1String("UseShellEscaping"), false).toBool());
+        generator->setTemplateFile(QFileInfo(templateFileName).isFile() ? templateFileName
+                                                                          : QString());
+        generator->setReplaceText(
+                settings.value(QLatin1String("TemplateReplaceText"), QLatin1String("<>"))
+                        .toString());
+        settings.beginGroup(QLatin1String("Preview"));
+        generator->setUsePreambleFormat(
+                settings.value(QLatin1String("UsePreambleFormat"), true).toBool());
+        generator->setUseCompileCache(
+                settings.value(QLatin1String("UseCompileCache"), true).toBool());
+        generator->setCompileCacheSize(
+                settings.value(QLatin1String("CompileCacheSize"), 100).toLongLong() * 1024
+                * 1024);
+        m_cpuTimeLimit = settings.value(QLatin1String("CpuTimeLimit"), 0).toInt();
+        m_memoryLimit = settings.value(QLatin1String("MemoryLimit"), 0).toInt();
+        m_timeLimit = settings.value(QLatin1String("TimeLimit"), 0).toInt();
+        generator->setResourceLimits(m_cpuTimeLimit, m_memoryLimit, m_timeLimit);
+        settings.endGroup();
+
+        // the following are called in the thread of the generator; the job
+        // of a slot is only changed when the generator is idle
+        connect(generator, &TikzPreviewGenerator::showErrorMessage, this,
+                [this, i](const QString &message) {
+                    Job &job = m_jobs[m_slots.at(i).job];
+                    if (job.error.isEmpty())
+                        job.error = message;
+                },
+                Qt::DirectConnection);
+        connect(generator, &TikzPreviewGenerator::compilationFinished, this,
+                [this, i](int elapsedTime) { m_jobs[m_slots.at(i).job].latexTime = elapsedTime; },
+                Qt::DirectConnection);
+        connect(generator, &TikzPreviewGenerator::previewFinished, this,
+                [this, i](bool success) {
+                    m_jobs[m_slots.at(i).job].success = success && writeOutputFiles(i);
+                    Q_EMIT jobFinished(i);
+                },
+                Qt::DirectConnection);
+
+        Slot slot;
+        slot.generator = generator;
+        slot.tempDir = 0;
+        slot.job = -1;
+        m_slots << slot;
+    }
+}
+
+/*!
+ * Lets the generator of \p slot compile the next file.  Returns false if
+ * there are no files left.
+ */
+
+bool TikzBatchRenderer::startJob(int slot)
+{
+    while (m_nextJob < m_jobs.size()) {
+        Job &job = m_jobs[m_nextJob];
+        job.timer.start();
+        if (!job.error.isEmpty()) {
+            QTextStream(stderr) << job.fileName << ": " << job.error << QLatin1Char('\n');
+            ++m_nextJob;
+            continue;
+        }
+        QFile tikzFile(job.fileName);
+        if (!tikzFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            job.error = tr("Cannot read file \"%1\":\n%2")
+                                .arg(job.fileName)
+                                .arg(tikzFile.errorString());
+            QTextStream(stderr) << job.fileName << ": " << job.error << QLatin1Char('\n');
+            ++m_nextJob;
+            continue;
+        }
+        QTextStream tikzStream(&tikzFile);
+        const QString tikzCode = tikzStream.readAll();
+        tikzFile.close();
+
+        Slot &jobSlot = m_slots[slot];
+        jobSlot.tempDir = new TempDir;
+        jobSlot.job = m_nextJob++;
+        ++m_runningJobCount;
+        jobSlot.generator->setTikzFileBaseName(jobSlot.tempDir->path()
+                                               + QLatin1String(s_tempFileName));
+        jobSlot.generator->setTikzCode(tikzCode);
+        // files input by the TikZ code are looked up next to it, as in the
+        // main window; the directory may already be in the search path
+        // (e.g. because it contains the template), then it must stay there
+        job.addedSearchPath =
+                jobSlot.generator->addToLatexSearchPath(QFileInfo(job.fileName).absolutePath());
+        jobSlot.generator->generatePreview(TikzPreviewGenerator::ReloadTemplate);
+        return true;
+    }
+    return false;
+}
+
+void TikzBatchRenderer::finishJob(int slot)
+{
+    Slot &jobSlot = m_slots[slot];
+    Job &job = m_jobs[jobSlot.job];
+    job.time = job.timer.elapsed();
+    if (!job.success) {
+        if (job.error.isEmpty())
+            job.error = tr("The file could not be rendered.");
+        QTextStream(stderr) << job.fileName << ": " << job.error << QLatin1Char('\n');
+    }
+    if (job.addedSearchPath)
+        jobSlot.generator->removeFromLatexSearchPath(QFileInfo(job.fileName).absolutePath());
+    delete jobSlot.tempDir;
+    jobSlot.tempDir = 0;
+    jobSlot.job = -1;
+    --m_runningJobCount;
+
+    if (!startJob(slot) && m_runningJobCount == 0)
+        m_eventLoop.quit();
+}
+
+/*!
+ * Writes the output files of the job of \p slot; this is run in the thread
+ * of the generator of \p slot after it has compiled the file.  Each page of
+ * the PDF file results in a PNG, EPS or SVG file.
+ */
+
+bool TikzBatchRenderer::writeOutputFiles(int slot)
+{
+    const Slot &jobSlot = m_slots.at(slot);
+    Job &job = m_jobs[jobSlot.job];
+    const QString pdfFileName = jobSlot.tempDir->path() + QLatin1String(s_tempFileName)
+            + QLatin1String(".pdf");
+    const QString outputBaseName = job.outputBaseName;
+
+    Poppler::Document *document = Poppler::Document::loadFromFile(pdfFileName);
+    if (!document) {
+        job.error = tr("Cannot load the PDF file.");
+        return false;
+    }
+    const int pageCount = document->numPages();
+    QStringList pageBaseNames;
+    QList<int> pages;
+    for (int i = 0; i < pageCount; ++i) {
+        pageBaseNames << (pageCount > 1 ? outputBaseName + QLatin1Char('_') + QString::number(i + 1)
+                                        : outputBaseName);
+        pages << i;
+    }
+
+    bool success = true;
+    if (m_formats & Pdf) {
+        const QString outputFileName = outputBaseName + QLatin1String(".pdf");
+        QFile::remove(outputFileName);
+        if (QFile::copy(pdfFileName, outputFileName))
+            job.outputFileNames << outputFileName;
+        else
+            success = false;
+    }
+    if (m_formats & Png) {
+        document->setRenderHint(Poppler::Document::Antialiasing);
+        document->setRenderHint(Poppler::Document::TextAntialiasing);
+        for (int i = 0; i < pageCount; ++i) {
+            Poppler::Page *page = document->page(i);
+            const QImage image = page ? page->renderToImage(m_resolution, m_resolution) : QImage();
+            delete page;
+            const QString outputFileName = pageBaseNames.at(i) + QLatin1String(".png");
+            if (!image.isNull() && image.save(outputFileName, "PNG"))
+                job.outputFileNames << outputFileName;
+            else
+                success = false;
+        }
+    }
+    delete document;
+    if (m_formats & Eps) {
+        QStringList outputFileNames;
+        for (const auto &pageBaseName : qAsConst(pageBaseNames))
+            outputFileNames << pageBaseName + QLatin1String(".eps");
+        if (jobSlot.generator->generateEpsFiles(pages, outputFileNames))
+            job.outputFileNames << outputFileNames;
+        else
+            success = false;
+    }
+    if (m_formats & Svg) {
+        // Poppler cannot write SVG files, so pdftocairo is used; it has the
+        // same limits as LaTeX, so that a bad file cannot hang the rendering
+        const int timeLimit = m_timeLimit > 0 ? m_timeLimit : s_defaultTimeLimit;
+        for (int i = 0; i < pageCount; ++i) {
+            const QString outputFileName = pageBaseNames.at(i) + QLatin1String(".svg");
+            TikzProcess process;
+            process.setResourceLimits(m_cpuTimeLimit, m_memoryLimit);
+            process.start(QLatin1String("pdftocairo"),
+                          QStringList() << QLatin1String("-svg") << QLatin1String("-f")
+                                        << QString::number(i + 1) << QLatin1String("-l")
+                                        << QString::number(i + 1) << pdfFileName
+                                        << outputFileName);
+            const bool finished = process.waitForFinished(timeLimit * 1000);
+            if (!finished && process.state() != QProcess::NotRunning) {
+                process.killProcessGroup();
+                process.waitForFinished(1000);
+            }
+            if (finished && process.exitStatus() == QProcess::NormalExit
+                && process.exitCode() == 0)
+                job.outputFileNames << outputFileName;
+            else
+                success = false;
+        }
+    }
+
+    if (!success)
+        job.error = tr("Not all output files could be written.");
+    return success;
+}
+
+bool TikzBatchRenderer::writeSummary() const
+{
+    QJsonArray files;
+    int failedCount = 0;
+    for (const auto &job : qAsConst(m_jobs)) {
+        QJsonObject file;
+        file.insert(QLatin1String("file"), job.fileName);
+        file.insert(QLatin1String("success"), job.success);
+        file.insert(QLatin1String("time"), job.time);
+        if (job.latexTime >= 0)
+            file.insert(QLatin1String("latexTime"), job.latexTime);
+        file.insert(QLatin1String("outputs"), QJsonArray::fromStringList(job.outputFileNames));
+        if (!job.error.isEmpty())
+            file.insert(QLatin1String("error"), job.error);
+        files.append(file);
+        if (!job.success)
+            ++failedCount;
+    }
+    QJsonObject summary;
+    summary.insert(QLatin1String("files"), files);
+    summary.insert(QLatin1String("succeeded"), m_jobs.size() - failedCount);
+    summary.insert(QLatin1String("failed"), failedCount);
+    summary.insert(QLatin1String("time"), m_timer.elapsed());
+    const QByteArray summaryData = QJsonDocument(summary).toJson();
+
+    QFile summaryFile;
+    if (m_summaryFileName.isEmpty()) {
+        summaryFile.open(stdout, QIODevice::WriteOnly);
+    } else {
+        summaryFile.setFileName(m_summaryFileName);
+        if (!summaryFile.open(QIODevice::WriteOnly)) {
+            QTextStream(stderr) << tr("Cannot write file \"%1\":\n%2")
+                                           .arg(m_summaryFileName)
+                                           .arg(summaryFile.errorString())
+                                << QLatin1Char('\n');
+            return false;
+        }
+    }
+    return summaryFile.write(summaryData) == summaryData.size();
+}
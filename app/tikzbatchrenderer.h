@@ -0,0 +1,106 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#ifndef KTIKZ_TIKZBATCHRENDERER_H
+#define KTIKZ_TIKZBATCHRENDERER_H
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QEventLoop>
+#include <QtCore/QObject>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+class TempDir;
+class TikzPreviewGenerator;
+
+/**
+ * Renders TikZ files to PDF, PNG, EPS and SVG files without user interface,
+ * e.g. when ktikz is run with --render.  The files are compiled by a pool of
+ * preview generators (each with its own temporary directory for each file),
+ * so that several files are compiled in parallel.
+ */
+class TikzBatchRenderer : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Format { Pdf = 0x1, Png = 0x2, Eps = 0x4, Svg = 0x8 };
+    Q_DECLARE_FLAGS(Formats, Format)
+
+    explicit TikzBatchRenderer(QObject *parent = 0);
+    ~TikzBatchRenderer();
+
+    void setOutputDirectory(const QString &path);
+    void setFormats(Formats formats);
+    void setResolution(int dpi);
+    void setMaximumJobCount(int count);
+    void setTemplateFile(const QString &fileName);
+    void setSummaryFile(const QString &fileName);
+    int render(const QStringList &fileNames);
+
+Q_SIGNALS:
+    void jobFinished(int slot);
+
+private Q_SLOTS:
+    void finishJob(int slot);
+
+private:
+    struct Job
+    {
+        QString fileName;
+        QString outputBaseName; // the output files are named after it
+        bool addedSearchPath; // the directory of the file has been added to TEXINPUTS
+        QElapsedTimer timer;
+        qint64 time; // in msec
+        qint64 latexTime; // in msec, -1 if LaTeX has not been run
+        bool success;
+        QString error;
+        QStringList outputFileNames;
+    };
+    struct Slot
+    {
+        TikzPreviewGenerator *generator;
+        TempDir *tempDir;
+        int job; // -1 if the generator is idle
+    };
+
+    void createGenerators(int count);
+    bool startJob(int slot);
+    bool writeOutputFiles(int slot);
+    bool writeSummary() const;
+
+    QString m_outputDirectory;
+    Formats m_formats;
+    int m_resolution;
+    int m_maximumJobCount;
+    QString m_templateFileName;
+    QString m_summaryFileName;
+    int m_cpuTimeLimit; // the limits of the LaTeX runs, also used for pdftocairo
+    int m_memoryLimit;
+    int m_timeLimit;
+
+    QVector<Job> m_jobs;
+    QVector<Slot> m_slots;
+    int m_nextJob;
+    int m_runningJobCount;
+    QElapsedTimer m_timer;
+    QEventLoop m_eventLoop;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(TikzBatchRenderer::Formats)
+
+#endif
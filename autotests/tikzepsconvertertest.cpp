@@ -0,0 +1,129 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+
+#include "tikzepsconverter.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QProcess>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QTemporaryDir>
+#include <QtTest/QtTest>
+
+class TikzEpsConverterTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void boundingBoxMatchesPdftops_data();
+    void boundingBoxMatchesPdftops();
+};
+
+/*!
+ * Returns a PDF file with one page of \p width x \p height points, on which
+ * a rectangle is drawn, like the page of a TikZ picture cropped by the
+ * preview package.
+ */
+
+static QByteArray samplePdf(const QByteArray &width, const QByteArray &height)
+{
+    const QByteArray content = "0 0 1 rg 2 2 " + width + ' ' + height + " re f\n";
+    QList<QByteArray> objects;
+    objects << "<< /Type /Catalog /Pages 2 0 R >>"
+            << "<< /Type /Pages /Kids [3 0 R] /Count 1 >>"
+            << "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 " + width + ' ' + height
+                    + "] /Contents 4 0 R /Resources << >> >>"
+            << "<< /Length " + QByteArray::number(content.size()) + " >>\nstream\n" + content
+                    + "endstream";
+
+    QByteArray pdf = "%PDF-1.4\n";
+    QList<int> offsets;
+    for (int i = 0; i < objects.size(); ++i) {
+        offsets << pdf.size();
+        pdf += QByteArray::number(i + 1) + " 0 obj\n" + objects.at(i) + "\nendobj\n";
+    }
+    const int xrefOffset = pdf.size();
+    pdf += "xref\n0 " + QByteArray::number(objects.size() + 1) + "\n0000000000 65535 f \n";
+    for (int offset : offsets)
+        pdf += QByteArray::number(offset).rightJustified(10, '0') + " 00000 n \n";
+    pdf += "trailer\n<< /Size " + QByteArray::number(objects.size() + 1)
+            + " /Root 1 0 R >>\nstartxref\n" + QByteArray::number(xrefOffset) + "\n%%EOF\n";
+    return pdf;
+}
+
+static QByteArray boundingBox(const QString &epsFileName)
+{
+    QFile epsFile(epsFileName);
+    if (!epsFile.open(QIODevice::ReadOnly))
+        return QByteArray();
+    while (!epsFile.atEnd()) {
+        const QByteArray line = epsFile.readLine().trimmed();
+        if (line.startsWith("%%BoundingBox:"))
+            return line;
+    }
+    return QByteArray();
+}
+
+void TikzEpsConverterTest::boundingBoxMatchesPdftops_data()
+{
+    QTest::addColumn<QByteArray>("width");
+    QTest::addColumn<QByteArray>("height");
+
+    QTest::newRow("integer size") << QByteArray("200") << QByteArray("100");
+    QTest::newRow("fractional size") << QByteArray("123.4") << QByteArray("56.7");
+}
+
+void TikzEpsConverterTest::boundingBoxMatchesPdftops()
+{
+    QFETCH(QByteArray, width);
+    QFETCH(QByteArray, height);
+
+    const QString pdftopsCommand = QStandardPaths::findExecutable(QLatin1String("pdftops"));
+    if (pdftopsCommand.isEmpty())
+        QSKIP("pdftops is not installed");
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QByteArray pdfData = samplePdf(width, height);
+    const QString pdfFileName = dir.filePath(QLatin1String("sample.pdf"));
+    QFile pdfFile(pdfFileName);
+    QVERIFY(pdfFile.open(QIODevice::WriteOnly));
+    QCOMPARE(pdfFile.write(pdfData), qint64(pdfData.size()));
+    pdfFile.close();
+
+    const QString popplerEpsFileName = dir.filePath(QLatin1String("poppler.eps"));
+    QVERIFY(TikzEpsConverter::convert(pdfData, QList<int>() << 0,
+                                      QStringList() << popplerEpsFileName)
+                    .isEmpty());
+
+    const QString pdftopsEpsFileName = dir.filePath(QLatin1String("pdftops.eps"));
+    QProcess pdftops;
+    pdftops.start(pdftopsCommand,
+                  QStringList() << QLatin1String("-f") << QLatin1String("1")
+                                << QLatin1String("-l") << QLatin1String("1")
+                                << QLatin1String("-eps") << pdfFileName << pdftopsEpsFileName);
+    QVERIFY(pdftops.waitForFinished(30000));
+    QCOMPARE(pdftops.exitCode(), 0);
+
+    const QByteArray expectedBoundingBox = boundingBox(pdftopsEpsFileName);
+    QVERIFY(!expectedBoundingBox.isEmpty());
+    QCOMPARE(boundingBox(popplerEpsFileName), expectedBoundingBox);
+}
+
+QTEST_GUILESS_MAIN(TikzEpsConverterTest)
+
+#include "tikzepsconvertertest.moc"
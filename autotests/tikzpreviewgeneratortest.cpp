@@ -0,0 +1,116 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+
+#include "tikzpreviewgenerator.h"
+#include "tikzpreviewcontroller.h"
+#include "utils/file.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QTemporaryDir>
+#include <QtTest/QtTest>
+
+static const qint64 s_maxWaitTime = 100; // in msec, the longest call in the main thread
+static const int s_testTime = 3000; // in msec
+static const int s_requestInterval = 100; // in msec, a new preview is requested this often
+
+// the generator is run without controller, as in the batch renderer, so it
+// never calls these
+QString TikzPreviewController::tikzCode() const
+{
+    return QString();
+}
+
+const TextCodecProfile *TikzPreviewController::textCodecProfile() const
+{
+    return 0;
+}
+
+class TikzPreviewGeneratorTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void mainThreadDoesNotWait();
+};
+
+/*!
+ * Calls the functions which the main thread calls while the generator is
+ * writing the files, running LaTeX and being aborted, and checks that none
+ * of them waits for the generator.
+ */
+
+void TikzPreviewGeneratorTest::mainThreadDoesNotWait()
+{
+#ifdef Q_OS_WIN
+    QSKIP("the LaTeX command is replaced by a shell script");
+#endif
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    File::setTempDir(dir.path() + QLatin1Char('/'));
+
+    // the LaTeX command only takes its time, so that a job is always running
+    const QString latexCommand = dir.filePath(QLatin1String("slowlatex"));
+    QFile latexScript(latexCommand);
+    QVERIFY(latexScript.open(QIODevice::WriteOnly));
+    latexScript.write("#!/bin/sh\nsleep 1\nexit 1\n");
+    latexScript.close();
+    QVERIFY(latexScript.setPermissions(latexScript.permissions() | QFileDevice::ExeOwner));
+
+    TikzPreviewGenerator generator(0);
+    generator.setLatexCommand(latexCommand);
+    generator.setUsePreambleFormat(false);
+    generator.setUseCompileCache(false);
+    generator.setTikzFileBaseName(dir.filePath(QLatin1String("preview")));
+    generator.setTikzCode(QLatin1String("\\begin{tikzpicture}\\draw (0,0) -- (1,1);"
+                                        "\\end{tikzpicture}"));
+    QSignalSpy runningSpy(&generator, &TikzPreviewGenerator::processRunning);
+    generator.generatePreview(TikzPreviewGenerator::ReloadTemplate);
+    QVERIFY(runningSpy.wait(5000));
+
+    QElapsedTimer testTimer;
+    testTimer.start();
+    QElapsedTimer requestTimer;
+    requestTimer.start();
+    QElapsedTimer callTimer;
+    qint64 maxWaitTime = 0; // in nsec
+    for (int i = 0; testTimer.elapsed() < s_testTime; ++i) {
+        callTimer.start();
+        generator.setForeground(i % 2 == 0);
+        generator.setCompileTimeEstimate(i % 3 == 0 ? -1 : 1000);
+        generator.setFinishFraction(i % 5 == 0 ? -1 : 0.5);
+        generator.getLogText();
+        generator.hasRunFailed();
+        if (requestTimer.elapsed() >= s_requestInterval) {
+            requestTimer.restart();
+            generator.setTikzCode(QLatin1String("\\begin{tikzpicture}\\draw (0,0) -- (")
+                                  + QString::number(i) + QLatin1String(",1);\\end{tikzpicture}"));
+            generator.generatePreview();
+        }
+        maxWaitTime = qMax(maxWaitTime, callTimer.nsecsElapsed());
+    }
+    generator.abortProcess();
+
+    QVERIFY2(maxWaitTime < s_maxWaitTime * 1000000,
+             qPrintable(QString::fromLatin1("the main thread has waited %1 ms")
+                                .arg(maxWaitTime / 1000000.0)));
+}
+
+QTEST_GUILESS_MAIN(TikzPreviewGeneratorTest)
+
+#include "tikzpreviewgeneratortest.moc"
@@ -0,0 +1,85 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+
+#include "tikzlogscanner.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QTextStream>
+
+/*!
+ * Returns a log of about \p size bytes which looks like the log of a
+ * pgfplots figure: mostly file names, overfull box messages and plot
+ * output, with an occasional warning or error.
+ */
+
+static QString syntheticLog(int size)
+{
+    static const char *const lines[] = {
+        "(/usr/share/texlive/texmf-dist/tex/latex/pgfplots/pgfplots.code.tex",
+        "Package pgfplots info on input line 12: computing plot 3 of 7",
+        "Overfull \\hbox (3.41667pt too wide) in paragraph at lines 14--15",
+        "[]\\OT1/cmr/m/n/10 (-1.5,2.25) (-1.4,1.96) (-1.3,1.69) (-1.2,1.44) (-1.1,1.21)",
+        "LaTeX Warning: Reference `fig:plot' on page 1 undefined on input line 20.",
+        "",
+        "./preview.tex:21: Undefined control sequence.",
+        "l.21 \\draw \\foo",
+        "                 (0,0) -- (1,1);",
+    };
+    QString log;
+    log.reserve(size + 100);
+    for (int i = 0; log.size() < size; ++i) {
+        log += QLatin1String(lines[i % int(sizeof(lines) / sizeof(lines[0]))]);
+        log += QLatin1Char('\n');
+    }
+    return log;
+}
+
+/*!
+ * Measures the throughput of TikzLogScanner::scan() on the log given as
+ * argument or on a synthetic log of 16 MiB.
+ */
+
+int main(int argc, char *argv[])
+{
+    QTextStream out(stdout);
+    QString log;
+    if (argc > 1) {
+        QFile logFile(QString::fromLocal8Bit(argv[1]));
+        if (!logFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            out << "Cannot open " << logFile.fileName() << '\n';
+            return 1;
+        }
+        log = QString::fromLocal8Bit(logFile.readAll());
+    } else
+        log = syntheticLog(16 * 1024 * 1024);
+
+    const int runs = 10;
+    int diagnosticCount = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for (int run = 0; run < runs; ++run)
+        diagnosticCount = TikzLogScanner::scan(log).size();
+    const qint64 elapsed = qMax<qint64>(1, timer.elapsed());
+
+    const double megabytes = double(log.size()) * runs / (1024 * 1024);
+    out << "scanned " << log.size() << " characters " << runs << " times, found "
+        << diagnosticCount << " diagnostics per run\n";
+    out << "throughput: " << megabytes * 1000 / elapsed << " MB/s\n";
+    return 0;
+}
@@ -1,4 +1,4 @@
-QT *= widgets printsupport
+QT *= widgets printsupport svg
 
 include($${_PRO_FILE_PWD_}/qmake/findpoppler.pri)
 
@@ -9,11 +9,19 @@ include($${PWD}/utils/utils.pri)
 FORMS += $${PWD}/templatewidget.ui
 SOURCES += \
 	$${PWD}/templatewidget.cpp \
+	$${PWD}/tikzcompilecache.cpp \
+	$${PWD}/tikzcompilescheduler.cpp \
+	$${PWD}/tikzepsconverter.cpp \
+	$${PWD}/tikzformatcache.cpp \
+	$${PWD}/tikzgnuplotcache.cpp \
+	$${PWD}/tikzlogscanner.cpp \
+	$${PWD}/tikzpicturemetrics.cpp \
 	$${PWD}/tikzpreview.cpp \
 	$${PWD}/tikzpreviewcontroller.cpp \
 	$${PWD}/tikzpreviewgenerator.cpp \
 	$${PWD}/tikzpreviewmessagewidget.cpp \
-	$${PWD}/tikzpreviewrenderer.cpp
+	$${PWD}/tikzpreviewrenderer.cpp \
+	$${PWD}/tikzprocess.cpp
 HEADERS += \
 #	$$headerFiles($$SOURCES) \
 	$${PWD}/mainwidget.h \
@@ -0,0 +1,213 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#include "tikzcompilecache.h"
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QProcessEnvironment>
+#include <QtCore/QStandardPaths>
+
+static QAtomicInt s_hitCount;
+static QAtomicInt s_missCount;
+
+static const char *const s_extensions[] = { ".log", ".ktikzaux", ".pdf" };
+
+TikzCompileCache::TikzCompileCache() : m_maximumSize(100 * 1024 * 1024) { }
+
+/*!
+ * Returns the name under which the result of compiling \p tikzCode in
+ * \p latexCode (the template in which the TikZ code is input) is stored.
+ * \p dependencies are the files read by LaTeX besides the TikZ code and the
+ * template, such as data tables; the result changes when one of them does.
+ */
+
+QString TikzCompileCache::key(const QString &latexCode, const QString &tikzCode,
+                              const QString &latexCommand, bool useShellEscaping,
+                              const QProcessEnvironment &environment,
+                              const QStringList &dependencies)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(latexCommand.toUtf8());
+    hash.addData(useShellEscaping ? "\n1\n" : "\n0\n", 3);
+    hash.addData(environment.value(QLatin1String("TEXINPUTS")).toUtf8());
+    hash.addData("\n", 1);
+    hash.addData(latexCode.toUtf8());
+    hash.addData("\n", 1);
+    hash.addData(tikzCode.toUtf8());
+    hash.addData(dependencyStamp(dependencies));
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+/*!
+ * Returns a string which changes when one of the files \p dependencies is
+ * modified, created or removed.
+ */
+
+QByteArray TikzCompileCache::dependencyStamp(const QStringList &dependencies)
+{
+    QByteArray stamp;
+    for (const auto &dependency : dependencies) {
+        const QFileInfo dependencyInfo(dependency);
+        stamp += '\n' + dependency.toUtf8() + ';' + QByteArray::number(dependencyInfo.size()) + ';'
+                + QByteArray::number(dependencyInfo.lastModified().toMSecsSinceEpoch());
+    }
+    return stamp;
+}
+
+void TikzCompileCache::setMaximumSize(qint64 maximumSize)
+{
+    m_maximumSize = maximumSize;
+}
+
+/***************************************************************************/
+
+static bool copyFile(const QString &fromFileName, const QString &toFileName)
+{
+    QFile::remove(toFileName);
+    return !QFileInfo::exists(fromFileName) || QFile::copy(fromFileName, toFileName);
+}
+
+/*!
+ * Returns true if results are stored for \p key.  Each call counts as a hit
+ * or a miss in the statistics of the cache.
+ */
+
+bool TikzCompileCache::find(const QString &key) const
+{
+    if (!QFileInfo::exists(cacheDirectory() + QLatin1Char('/') + key + QLatin1String(".pdf"))) {
+        s_missCount.ref();
+        return false;
+    }
+    s_hitCount.ref();
+    qDebug() << "compile cache hit" << key << "(" << s_hitCount.load() << "hits,"
+             << s_missCount.load() << "misses)";
+    return true;
+}
+
+/*!
+ * Copies the stored results for \p key to the PDF, log and auxiliary files
+ * with base name \p tikzFileBaseName.  Returns false if this fails, e.g.
+ * because the results have been removed in the meantime.
+ */
+
+bool TikzCompileCache::restore(const QString &key, const QString &tikzFileBaseName)
+{
+    const QString baseName = cacheDirectory() + QLatin1Char('/') + key;
+    QFile pdfFile(baseName + QLatin1String(".pdf"));
+    bool success = pdfFile.exists();
+    for (const char *extension : s_extensions) {
+        if (!success)
+            break;
+        success = copyFile(baseName + QLatin1String(extension),
+                           tikzFileBaseName + QLatin1String(extension));
+    }
+    if (!success)
+        return false;
+
+    // the modification time of the PDF file is the time of last use
+    if (pdfFile.open(QIODevice::ReadWrite)) {
+        pdfFile.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+        pdfFile.close();
+    }
+    return true;
+}
+
+/*!
+ * Stores the PDF and auxiliary files with base name \p tikzFileBaseName and
+ * the log file with base name \p logFileBaseName under \p key.
+ */
+
+void TikzCompileCache::store(const QString &key, const QString &tikzFileBaseName,
+                             const QString &logFileBaseName)
+{
+    const QString dir = cacheDirectory();
+    if (!QDir().mkpath(dir))
+        return;
+
+    // the PDF file is copied last under a temporary name, so that a result
+    // is only found when all its files are complete
+    const QString baseName = dir + QLatin1Char('/') + key;
+    const QString tempPdfFileName = baseName + QLatin1String(".pdf.part");
+    if (!copyFile(logFileBaseName + QLatin1String(".log"), baseName + QLatin1String(".log"))
+        || !copyFile(tikzFileBaseName + QLatin1String(".ktikzaux"),
+                     baseName + QLatin1String(".ktikzaux"))
+        || !copyFile(tikzFileBaseName + QLatin1String(".pdf"), tempPdfFileName)) {
+        QFile::remove(tempPdfFileName);
+        return;
+    }
+    QFile::remove(baseName + QLatin1String(".pdf"));
+    QFile::rename(tempPdfFileName, baseName + QLatin1String(".pdf"));
+
+    prune();
+}
+
+void TikzCompileCache::prune()
+{
+    const QString dir = cacheDirectory();
+    const QFileInfoList pdfFileInfos = QDir(dir).entryInfoList(
+            QStringList() << QLatin1String("*.pdf"), QDir::Files, QDir::Time);
+    qint64 totalSize = 0;
+    for (const auto &pdfFileInfo : pdfFileInfos) { // most recently used first
+        const QString baseName = dir + QLatin1Char('/') + pdfFileInfo.completeBaseName();
+        qint64 entrySize = 0;
+        for (const char *extension : s_extensions)
+            entrySize += QFileInfo(baseName + QLatin1String(extension)).size();
+        totalSize += entrySize;
+        if (totalSize > m_maximumSize) {
+            for (const char *extension : s_extensions)
+                QFile::remove(baseName + QLatin1String(extension));
+        }
+    }
+}
+
+/***************************************************************************/
+
+QString TikzCompileCache::cacheDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+            + QLatin1String("/previews");
+}
+
+qint64 TikzCompileCache::size()
+{
+    qint64 totalSize = 0;
+    const QFileInfoList fileInfos = QDir(cacheDirectory()).entryInfoList(QDir::Files);
+    for (const auto &fileInfo : fileInfos)
+        totalSize += fileInfo.size();
+    return totalSize;
+}
+
+void TikzCompileCache::clear()
+{
+    QDir(cacheDirectory()).removeRecursively();
+}
+
+int TikzCompileCache::hitCount()
+{
+    return s_hitCount.load();
+}
+
+int TikzCompileCache::missCount()
+{
+    return s_missCount.load();
+}
@@ -0,0 +1,62 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#ifndef KTIKZ_TIKZCOMPILECACHE_H
+#define KTIKZ_TIKZCOMPILECACHE_H
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+class QProcessEnvironment;
+
+/**
+ * Keeps the results (PDF file, log file and coordinates of the pictures) of
+ * successful runs of LaTeX in the cache directory, identified by a hash of
+ * everything which determines these results, so that undoing an edit or
+ * reopening a file does not require LaTeX to be run again.  When the cache
+ * grows larger than the maximum size, the least recently used results are
+ * removed.
+ */
+class TikzCompileCache
+{
+public:
+    TikzCompileCache();
+
+    static QString key(const QString &latexCode, const QString &tikzCode,
+                       const QString &latexCommand, bool useShellEscaping,
+                       const QProcessEnvironment &environment,
+                       const QStringList &dependencies = QStringList());
+    static QByteArray dependencyStamp(const QStringList &dependencies);
+    void setMaximumSize(qint64 maximumSize);
+    bool find(const QString &key) const;
+    bool restore(const QString &key, const QString &tikzFileBaseName);
+    void store(const QString &key, const QString &tikzFileBaseName,
+               const QString &logFileBaseName);
+
+    static QString cacheDirectory();
+    static qint64 size();
+    static void clear();
+    static int hitCount();
+    static int missCount();
+
+private:
+    void prune();
+
+    qint64 m_maximumSize;
+};
+
+#endif
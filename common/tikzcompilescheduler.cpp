@@ -0,0 +1,141 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#include "tikzcompilescheduler.h"
+
+#include <QtCore/QObject>
+#include <QtCore/QThread>
+
+TikzCompileScheduler::TikzCompileScheduler()
+    : m_runningCount(0), m_maximumRunningCount(QThread::idealThreadCount())
+{
+}
+
+TikzCompileScheduler *TikzCompileScheduler::instance()
+{
+    static TikzCompileScheduler scheduler;
+    return &scheduler;
+}
+
+/*!
+ * Sets the number of processes which may run at the same time; if
+ * \p maximumRunningCount is not positive, the number of processor cores
+ * is used.
+ */
+
+void TikzCompileScheduler::setMaximumRunningCount(int maximumRunningCount)
+{
+    const QMutexLocker lock(&m_mutex);
+    m_maximumRunningCount =
+            maximumRunningCount > 0 ? maximumRunningCount : qMax(1, QThread::idealThreadCount());
+    m_condition.wakeAll();
+}
+
+/*!
+ * Waits until a process may be started.  Returns false if \p cancelled has
+ * been set in the meantime (wakeAll() must be called after setting it).
+ * \p waitingCount is set to the number of requests which were already
+ * waiting.
+ */
+
+bool TikzCompileScheduler::acquire(bool isForeground, const QAtomicInt *cancelled,
+                                   int *waitingCount)
+{
+    const QMutexLocker lock(&m_mutex);
+    Waiter waiter = { isForeground };
+    int index = m_waiters.size();
+    if (isForeground) {
+        index = 0;
+        while (index < m_waiters.size() && m_waiters.at(index)->isForeground)
+            ++index;
+    }
+    *waitingCount = m_waiters.size();
+    m_waiters.insert(index, &waiter);
+
+    while (!cancelled->loadAcquire()
+           && (m_waiters.first() != &waiter || m_runningCount >= m_maximumRunningCount)) {
+        // a slot held by a process which is only waiting for work is given
+        // back by its holder, which must then call release()
+        if (m_runningCount >= m_maximumRunningCount && !m_idleHolders.isEmpty()) {
+            const IdleHolder idleHolder = m_idleHolders.takeFirst();
+            QMetaObject::invokeMethod(idleHolder.holder, idleHolder.reclaimMethod,
+                                      Qt::QueuedConnection);
+        }
+        m_condition.wait(&m_mutex);
+    }
+    m_waiters.removeOne(&waiter);
+    m_condition.wakeAll(); // the next request may be able to run now
+    if (cancelled->loadAcquire())
+        return false;
+    ++m_runningCount;
+    return true;
+}
+
+/*!
+ * Takes a slot without waiting.  Returns false if no slot is free or if
+ * other requests are waiting for one.
+ */
+
+bool TikzCompileScheduler::tryAcquire()
+{
+    const QMutexLocker lock(&m_mutex);
+    if (!m_waiters.isEmpty() || m_runningCount >= m_maximumRunningCount)
+        return false;
+    ++m_runningCount;
+    return true;
+}
+
+void TikzCompileScheduler::release()
+{
+    const QMutexLocker lock(&m_mutex);
+    --m_runningCount;
+    m_condition.wakeAll();
+}
+
+/*!
+ * Marks the slot of \p holder as idle: its process is waiting for work.
+ * When a request must wait for a slot, \p reclaimMethod of \p holder is
+ * invoked (queued, in the thread of \p holder), which must stop the process
+ * and release the slot.
+ */
+
+void TikzCompileScheduler::setIdle(QObject *holder, const char *reclaimMethod)
+{
+    const QMutexLocker lock(&m_mutex);
+    const IdleHolder idleHolder = { holder, reclaimMethod };
+    m_idleHolders << idleHolder;
+    m_condition.wakeAll(); // a waiting request may reclaim the slot
+}
+
+/*!
+ * Marks the slot of \p holder as used again, so that it is not reclaimed
+ * anymore.
+ */
+
+void TikzCompileScheduler::setBusy(QObject *holder)
+{
+    const QMutexLocker lock(&m_mutex);
+    for (int i = m_idleHolders.size() - 1; i >= 0; --i)
+        if (m_idleHolders.at(i).holder == holder)
+            m_idleHolders.removeAt(i);
+}
+
+void TikzCompileScheduler::wakeAll()
+{
+    const QMutexLocker lock(&m_mutex);
+    m_condition.wakeAll();
+}
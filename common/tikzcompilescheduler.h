@@ -0,0 +1,70 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#ifndef KTIKZ_TIKZCOMPILESCHEDULER_H
+#define KTIKZ_TIKZCOMPILESCHEDULER_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+
+class QObject;
+
+/**
+ * Limits the number of LaTeX processes which are run at the same time by
+ * all windows of the application.  The generator threads wait in acquire()
+ * until a slot is free; requests of the window which has the focus are
+ * served before those of windows in the background.  Processes which are
+ * started in advance (resident workers and format dumps) only take a slot
+ * with tryAcquire() if one is free.
+ */
+class TikzCompileScheduler
+{
+public:
+    static TikzCompileScheduler *instance();
+
+    void setMaximumRunningCount(int maximumRunningCount);
+    bool acquire(bool isForeground, const QAtomicInt *cancelled, int *waitingCount);
+    bool tryAcquire();
+    void release();
+    void setIdle(QObject *holder, const char *reclaimMethod);
+    void setBusy(QObject *holder);
+    void wakeAll();
+
+private:
+    TikzCompileScheduler();
+
+    struct Waiter
+    {
+        bool isForeground;
+    };
+    struct IdleHolder
+    {
+        QObject *holder;
+        const char *reclaimMethod;
+    };
+
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    QList<Waiter *> m_waiters; // foreground requests first, then in order of arrival
+    QList<IdleHolder> m_idleHolders; // slots held by processes waiting for work
+    int m_runningCount;
+    int m_maximumRunningCount;
+};
+
+#endif
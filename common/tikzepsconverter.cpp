@@ -0,0 +1,121 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#include "tikzepsconverter.h"
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QByteArray>
+#include <QtCore/QEventLoop>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <QtCore/QVector>
+#include <QtCore/QtMath>
+#include <poppler-qt5.h>
+
+namespace {
+
+class EpsConversionJob : public QRunnable
+{
+public:
+    EpsConversionJob(const QByteArray &pdfData, int page, const QString &epsFileName,
+                     bool *success, QAtomicInt *remainingCount, QEventLoop *eventLoop)
+        : m_pdfData(pdfData),
+          m_page(page),
+          m_epsFileName(epsFileName),
+          m_success(success),
+          m_remainingCount(remainingCount),
+          m_eventLoop(eventLoop)
+    {
+    }
+
+    void run() override
+    {
+        *m_success = convertPage();
+        // the event loop is only left when all jobs have finished
+        if (!m_remainingCount->deref())
+            QMetaObject::invokeMethod(m_eventLoop, "quit", Qt::QueuedConnection);
+    }
+
+private:
+    bool convertPage()
+    {
+        Poppler::Document *document = Poppler::Document::loadFromData(m_pdfData);
+        if (!document || document->isLocked()) {
+            delete document;
+            return false;
+        }
+        Poppler::Page *page = document->page(m_page);
+        if (!page) {
+            delete document;
+            return false;
+        }
+        const QSizeF pageSize = page->pageSizeF();
+        delete page;
+
+        // the paper has the size of the page, so that the bounding box of
+        // the EPS file is that of the picture
+        Poppler::PSConverter *psConverter = document->psConverter();
+        psConverter->setOutputFileName(m_epsFileName);
+        psConverter->setPageList(QList<int>() << m_page + 1);
+        psConverter->setPaperWidth(qCeil(pageSize.width()));
+        psConverter->setPaperHeight(qCeil(pageSize.height()));
+        psConverter->setPSOptions(Poppler::PSConverter::PrintToEPS);
+        const bool success = psConverter->convert();
+        delete psConverter;
+        delete document;
+        return success;
+    }
+
+    const QByteArray m_pdfData;
+    const int m_page;
+    const QString m_epsFileName;
+    bool *m_success;
+    QAtomicInt *m_remainingCount;
+    QEventLoop *m_eventLoop;
+};
+
+} // anonymous namespace
+
+/*!
+ * Converts each page in \p pages (counting from 0) of the PDF file in
+ * \p pdfData to the file at the same position in \p epsFileNames.  Returns
+ * the pages which could not be converted.  The events of the calling thread
+ * (except for user input) are handled while the pages are being converted.
+ */
+
+QList<int> TikzEpsConverter::convert(const QByteArray &pdfData, const QList<int> &pages,
+                                     const QStringList &epsFileNames)
+{
+    Q_ASSERT(pages.size() == epsFileNames.size());
+    if (pages.isEmpty())
+        return QList<int>();
+
+    QEventLoop eventLoop;
+    QAtomicInt remainingCount(pages.size());
+    QVector<bool> success(pages.size(), false);
+    for (int i = 0; i < pages.size(); ++i)
+        QThreadPool::globalInstance()->start(new EpsConversionJob(
+                pdfData, pages.at(i), epsFileNames.at(i), success.data() + i, &remainingCount,
+                &eventLoop));
+    eventLoop.exec(QEventLoop::ExcludeUserInputEvents);
+
+    QList<int> failedPages;
+    for (int i = 0; i < pages.size(); ++i)
+        if (!success[i])
+            failedPages << pages.at(i);
+    return failedPages;
+}
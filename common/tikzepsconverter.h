@@ -0,0 +1,40 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#ifndef KTIKZ_TIKZEPSCONVERTER_H
+#define KTIKZ_TIKZEPSCONVERTER_H
+
+#include <QtCore/QList>
+#include <QtCore/QStringList>
+
+class QByteArray;
+
+/**
+ * Converts pages of a PDF file to EPS files with Poppler in the global
+ * thread pool, so that no external program is needed and the pages of a
+ * multi-page export are converted in parallel.  Since Poppler documents
+ * cannot be shared between threads, each conversion loads its own copy of
+ * the document from the PDF data.
+ */
+class TikzEpsConverter
+{
+public:
+    static QList<int> convert(const QByteArray &pdfData, const QList<int> &pages,
+                              const QStringList &epsFileNames);
+};
+
+#endif
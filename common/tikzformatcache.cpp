@@ -0,0 +1,230 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#include "tikzformatcache.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QStandardPaths>
+
+#include "tikzcompilescheduler.h"
+
+TikzFormatCache::TikzFormatCache(QObject *parent) : QObject(parent), m_process(0)
+{
+    m_cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+            + QLatin1String("/formats");
+}
+
+TikzFormatCache::~TikzFormatCache()
+{
+    if (m_process) {
+        m_process->kill();
+        m_process->waitForFinished(1000);
+        TikzCompileScheduler::instance()->release();
+    }
+}
+
+/***************************************************************************/
+
+/*!
+ * Returns true if \p latexCommand is known to be able to dump a format
+ * containing the packages of a LaTeX preamble.  LuaLaTeX cannot dump its Lua
+ * state and ConTeXt has its own format handling, so they are not supported.
+ */
+
+bool TikzFormatCache::isSupportedCommand(const QString &latexCommand)
+{
+    const QString engine = QFileInfo(latexCommand).completeBaseName();
+    return engine == QLatin1String("pdflatex") || engine == QLatin1String("latex")
+            || engine == QLatin1String("xelatex");
+}
+
+/*!
+ * Splits \p latexCode at the first \\begin{document} which is not commented
+ * out.  Returns false if the code cannot be split such that the preamble can
+ * be dumped in a format and the body still contains the TikZ code.
+ */
+
+bool TikzFormatCache::splitLatexCode(const QString &latexCode, QString *preamble, QString *body)
+{
+    const QString beginDocument = QLatin1String("\\begin{document}");
+    int index = latexCode.indexOf(beginDocument);
+    while (index >= 0) {
+        const int lineStart = latexCode.lastIndexOf(QLatin1Char('\n'), index) + 1;
+        if (!latexCode.midRef(lineStart, index - lineStart).contains(QLatin1Char('%')))
+            break;
+        index = latexCode.indexOf(beginDocument, index + beginDocument.length());
+    }
+    if (index < 0)
+        return false;
+
+    *preamble = latexCode.left(index);
+    *body = latexCode.mid(index);
+    // the code which inputs the TikZ code must be in the body, otherwise the
+    // TikZ code would be frozen in the format
+    return preamble->contains(QLatin1String("\\documentclass"))
+            && !preamble->contains(QLatin1String("ktikzauxfile"));
+}
+
+/***************************************************************************/
+
+QString TikzFormatCache::formatName(const QString &preamble, const QString &latexCommand,
+                                    const QProcessEnvironment &environment) const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(latexCommand.toUtf8());
+    hash.addData("\n", 1);
+    hash.addData(environment.value(QLatin1String("TEXINPUTS")).toUtf8());
+    hash.addData("\n", 1);
+    hash.addData(preamble.toUtf8());
+    return QLatin1String("ktikz-") + QString::fromLatin1(hash.result().toHex());
+}
+
+/*!
+ * Returns the path (without extension, as expected by the -fmt option of
+ * LaTeX) of the format for \p preamble, or an empty string if that format
+ * has not been built yet.
+ */
+
+QString TikzFormatCache::formatFile(const QString &preamble, const QString &latexCommand,
+                                    const QProcessEnvironment &environment) const
+{
+    const QString name = formatName(preamble, latexCommand, environment);
+    if (m_failedFormatNames.contains(name))
+        return QString();
+    const QString path = m_cacheDir + QLatin1Char('/') + name;
+    return QFileInfo::exists(path + QLatin1String(".fmt")) ? path : QString();
+}
+
+/*!
+ * Starts building the format for \p preamble in the background.  Nothing
+ * happens if the format is already being built or if a previous attempt to
+ * build it failed.  The build counts as a running LaTeX process; if all
+ * slots of the compile scheduler are taken, it is postponed to the next
+ * call.
+ */
+
+void TikzFormatCache::buildFormat(const QString &preamble, const QString &latexCommand,
+                                  const QProcessEnvironment &environment)
+{
+    const QString name = formatName(preamble, latexCommand, environment);
+    if (m_failedFormatNames.contains(name))
+        return;
+
+    if (m_process) {
+        if (m_buildingFormatName == name)
+            return;
+        // the template has changed again while building the previous format
+        m_process->disconnect(this);
+        m_process->kill();
+        m_process->waitForFinished(1000);
+        delete m_process;
+        m_process = 0;
+        TikzCompileScheduler::instance()->release();
+    }
+
+    if (!QDir().mkpath(m_cacheDir) || !TikzCompileScheduler::instance()->tryAcquire())
+        return;
+
+    // build the format under a temporary name, so that other windows never
+    // see a partially written format file
+    m_buildingFormatName = name;
+    m_buildingJobName =
+            name + QLatin1Char('-') + QString::number(QCoreApplication::applicationPid());
+    QFile preambleFile(m_cacheDir + QLatin1Char('/') + m_buildingJobName + QLatin1String(".tex"));
+    if (!preambleFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        m_failedFormatNames.insert(name);
+        TikzCompileScheduler::instance()->release();
+        return;
+    }
+    preambleFile.write(preamble.toUtf8());
+    preambleFile.write("\n\\dump\n");
+    preambleFile.close();
+
+    const QString engine = QFileInfo(latexCommand).completeBaseName();
+    QStringList arguments;
+    arguments << QLatin1String("-ini") << QLatin1String("-interaction=nonstopmode")
+              << QLatin1String("-halt-on-error")
+              << QLatin1String("-jobname=") + m_buildingJobName << QLatin1Char('&') + engine
+              << preambleFile.fileName();
+
+    m_process = new QProcess(this);
+    m_process->setWorkingDirectory(m_cacheDir);
+    m_process->setProcessEnvironment(environment);
+    // the log file is written anyway, and we must not let the output pile
+    // up in a pipe while the generator thread is busy running LaTeX
+    m_process->setStandardOutputFile(QProcess::nullDevice());
+    m_process->setStandardErrorFile(QProcess::nullDevice());
+    connect(m_process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
+            &TikzFormatCache::buildFinished);
+    // finished() is not emitted if LaTeX cannot be started
+    connect(m_process, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
+        if (error == QProcess::FailedToStart)
+            buildFinished(-1, QProcess::CrashExit);
+    });
+    qDebug() << "building format" << name << "with" << latexCommand;
+    m_process->start(latexCommand, arguments);
+}
+
+void TikzFormatCache::buildFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    TikzCompileScheduler::instance()->release();
+    const QString jobPath = m_cacheDir + QLatin1Char('/') + m_buildingJobName;
+    const QString formatPath = m_cacheDir + QLatin1Char('/') + m_buildingFormatName;
+    bool success = exitStatus == QProcess::NormalExit && exitCode == 0
+            && QFileInfo::exists(jobPath + QLatin1String(".fmt"));
+    if (success) {
+        QFile::remove(formatPath + QLatin1String(".fmt"));
+        success = QFile::rename(jobPath + QLatin1String(".fmt"), formatPath + QLatin1String(".fmt"));
+    }
+    if (!success) {
+        qWarning() << "Error: building format" << m_buildingFormatName << "failed, see"
+                   << jobPath + QLatin1String(".log");
+        m_failedFormatNames.insert(m_buildingFormatName);
+        QFile::remove(jobPath + QLatin1String(".fmt"));
+    } else {
+        QFile::remove(jobPath + QLatin1String(".log"));
+    }
+    QFile::remove(jobPath + QLatin1String(".tex"));
+
+    m_process->deleteLater();
+    m_process = 0;
+    m_buildingFormatName.clear();
+    m_buildingJobName.clear();
+
+    Q_EMIT formatBuilt(success);
+}
+
+/*!
+ * Removes a format which turned out to be unusable (e.g. because the TeX
+ * installation was updated after the format was dumped).  The format is
+ * rebuilt once; if it is removed a second time, it is not used anymore
+ * during this session.
+ */
+
+void TikzFormatCache::removeFormat(const QString &formatFile)
+{
+    const QString name = QFileInfo(formatFile).fileName();
+    QFile::remove(formatFile + QLatin1String(".fmt"));
+    if (m_invalidFormatNames.contains(name))
+        m_failedFormatNames.insert(name);
+    m_invalidFormatNames.insert(name);
+}
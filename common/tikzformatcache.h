@@ -0,0 +1,66 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#ifndef KTIKZ_TIKZFORMATCACHE_H
+#define KTIKZ_TIKZFORMATCACHE_H
+
+#include <QtCore/QObject>
+#include <QtCore/QProcess>
+#include <QtCore/QSet>
+
+/**
+ * Keeps precompiled LaTeX formats (format dumps) of the preambles of the
+ * templates, so that the packages loaded in the preamble need not be loaded
+ * again on each run of LaTeX.  The formats are stored in the cache directory
+ * and are identified by a hash of the preamble and the LaTeX command.
+ */
+class TikzFormatCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TikzFormatCache(QObject *parent = 0);
+    ~TikzFormatCache();
+
+    static bool isSupportedCommand(const QString &latexCommand);
+    static bool splitLatexCode(const QString &latexCode, QString *preamble, QString *body);
+
+    QString formatFile(const QString &preamble, const QString &latexCommand,
+                       const QProcessEnvironment &environment) const;
+    void buildFormat(const QString &preamble, const QString &latexCommand,
+                     const QProcessEnvironment &environment);
+    void removeFormat(const QString &formatFile);
+
+Q_SIGNALS:
+    void formatBuilt(bool success);
+
+private Q_SLOTS:
+    void buildFinished(int exitCode, QProcess::ExitStatus exitStatus);
+
+private:
+    QString formatName(const QString &preamble, const QString &latexCommand,
+                       const QProcessEnvironment &environment) const;
+
+    QString m_cacheDir;
+    QProcess *m_process;
+    QString m_buildingFormatName;
+    QString m_buildingJobName;
+    QSet<QString> m_failedFormatNames;
+    QSet<QString> m_invalidFormatNames;
+};
+
+#endif
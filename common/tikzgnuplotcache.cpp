@@ -0,0 +1,242 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#include "tikzgnuplotcache.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QRegularExpression>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QTextStream>
+
+TikzGnuplotCache::TikzGnuplotCache() : m_maximumSize(100 * 1024 * 1024) { }
+
+/*!
+ * Returns the name of the index of the tables for the plots in \p tikzCode
+ * which are computed by gnuplot, or an empty string if there are no such
+ * plots.  Only the plot commands are hashed, so that the tables are still
+ * found after the rest of the TikZ code has been edited.
+ */
+
+QString TikzGnuplotCache::key(const QString &latexCode, const QString &tikzCode)
+{
+    static const QRegularExpression plotRegExp(QLatin1String("\\bplot\\b[^;]*;"));
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    bool hasGnuplotPlots = false;
+    QRegularExpressionMatchIterator it = plotRegExp.globalMatch(tikzCode);
+    while (it.hasNext()) {
+        const QString plotCommand = it.next().captured();
+        if (!plotCommand.contains(QLatin1String("function"))
+            && !plotCommand.contains(QLatin1String("gnuplot")))
+            continue;
+        hash.addData(plotCommand.toUtf8());
+        hash.addData("\n", 1);
+        hasGnuplotPlots = true;
+    }
+    if (!hasGnuplotPlots)
+        return QString();
+    hash.addData(latexCode.toUtf8());
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+void TikzGnuplotCache::setMaximumSize(qint64 maximumSize)
+{
+    m_maximumSize = maximumSize;
+}
+
+/***************************************************************************/
+
+static QByteArray fileHash(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(&file);
+    return hash.result().toHex();
+}
+
+static bool copyFile(const QString &fromFileName, const QString &toFileName)
+{
+    QFile::remove(toFileName);
+    return QFile::copy(fromFileName, toFileName);
+}
+
+static void touchFile(const QString &fileName)
+{
+    // the modification time of a file in the cache is the time of last use
+    QFile file(fileName);
+    if (file.open(QIODevice::ReadWrite)) {
+        file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+        file.close();
+    }
+}
+
+/*!
+ * Copies the tables (and their gnuplot scripts) listed in the index \p key
+ * to \p workingDir, unless the same script is already there.  Returns the
+ * number of restored tables.
+ */
+
+int TikzGnuplotCache::restore(const QString &key, const QString &workingDir)
+{
+    const QString dir = cacheDirectory();
+    QFile indexFile(dir + QLatin1Char('/') + key + QLatin1String(".index"));
+    if (!indexFile.open(QIODevice::ReadOnly | QIODevice::Text))
+        return 0;
+
+    int restoredCount = 0;
+    QTextStream index(&indexFile);
+    while (!index.atEnd()) {
+        const QStringList fields = index.readLine().split(QLatin1Char('\t'));
+        if (fields.size() != 2)
+            continue;
+        const QString cachedBaseName = dir + QLatin1Char('/') + fields.at(1);
+        const QString baseName = workingDir + QLatin1Char('/') + fields.at(0);
+        if (!QFileInfo::exists(cachedBaseName + QLatin1String(".table")))
+            continue;
+        if (fileHash(baseName + QLatin1String(".gnuplot")) == fields.at(1).toLatin1()
+            && QFileInfo::exists(baseName + QLatin1String(".table")))
+            continue;
+        if (copyFile(cachedBaseName + QLatin1String(".gnuplot"),
+                     baseName + QLatin1String(".gnuplot"))
+            && copyFile(cachedBaseName + QLatin1String(".table"),
+                        baseName + QLatin1String(".table"))) {
+            touchFile(cachedBaseName + QLatin1String(".table"));
+            ++restoredCount;
+        }
+    }
+    indexFile.close();
+    touchFile(indexFile.fileName());
+
+    if (restoredCount > 0)
+        qDebug() << "gnuplot cache:" << restoredCount << "tables restored";
+    return restoredCount;
+}
+
+/*!
+ * Stores the tables in \p workingDir which LaTeX has read according to the
+ * recorder files \p flsFileNames, together with the gnuplot scripts from
+ * which they have been computed, and lists them in the index \p key.
+ */
+
+void TikzGnuplotCache::store(const QString &key, const QString &workingDir,
+                             const QStringList &flsFileNames)
+{
+    QStringList tableFileNames;
+    for (const auto &flsFileName : flsFileNames) {
+        QFile flsFile(flsFileName);
+        if (!flsFile.open(QIODevice::ReadOnly | QIODevice::Text))
+            continue;
+        QDir currentDir(workingDir);
+        while (!flsFile.atEnd()) {
+            const QString line = QString::fromLocal8Bit(flsFile.readLine()).trimmed();
+            if (line.startsWith(QLatin1String("PWD ")))
+                currentDir.setPath(line.mid(4));
+            else if (line.startsWith(QLatin1String("INPUT "))
+                     && line.endsWith(QLatin1String(".table")))
+                tableFileNames << QDir::cleanPath(currentDir.absoluteFilePath(line.mid(6)));
+        }
+    }
+    tableFileNames.removeDuplicates();
+
+    const QString dir = cacheDirectory();
+    if (tableFileNames.isEmpty() || !QDir().mkpath(dir))
+        return;
+
+    QString indexText;
+    for (const auto &tableFileName : qAsConst(tableFileNames)) {
+        const QFileInfo tableFileInfo(tableFileName);
+        if (tableFileInfo.absolutePath() != QFileInfo(workingDir).absoluteFilePath())
+            continue; // a table which is part of the document
+        const QString baseName = tableFileInfo.absolutePath() + QLatin1Char('/')
+                + tableFileInfo.completeBaseName();
+        const QByteArray hash = fileHash(baseName + QLatin1String(".gnuplot"));
+        if (hash.isEmpty())
+            continue;
+
+        // the table is copied last under a temporary name, so that an
+        // entry is only found when both its files are complete
+        const QString cachedBaseName = dir + QLatin1Char('/') + QString::fromLatin1(hash);
+        if (!QFileInfo::exists(cachedBaseName + QLatin1String(".table"))) {
+            const QString tempTableFileName = cachedBaseName + QLatin1String(".table.part");
+            if (!copyFile(baseName + QLatin1String(".gnuplot"),
+                          cachedBaseName + QLatin1String(".gnuplot"))
+                || !copyFile(tableFileName, tempTableFileName)) {
+                QFile::remove(tempTableFileName);
+                continue;
+            }
+            QFile::rename(tempTableFileName, cachedBaseName + QLatin1String(".table"));
+        } else
+            touchFile(cachedBaseName + QLatin1String(".table"));
+        indexText += tableFileInfo.completeBaseName() + QLatin1Char('\t')
+                + QString::fromLatin1(hash) + QLatin1Char('\n');
+    }
+
+    QFile indexFile(dir + QLatin1Char('/') + key + QLatin1String(".index"));
+    if (!indexText.isEmpty() && indexFile.open(QIODevice::WriteOnly | QIODevice::Text))
+        indexFile.write(indexText.toUtf8());
+
+    prune();
+}
+
+void TikzGnuplotCache::prune()
+{
+    const QString dir = cacheDirectory();
+    const QFileInfoList fileInfos = QDir(dir).entryInfoList(
+            QStringList() << QLatin1String("*.table") << QLatin1String("*.index"), QDir::Files,
+            QDir::Time);
+    qint64 totalSize = 0;
+    for (const auto &fileInfo : fileInfos) { // most recently used first
+        const QString baseName = dir + QLatin1Char('/') + fileInfo.completeBaseName();
+        const bool isTable = fileInfo.suffix() == QLatin1String("table");
+        totalSize += fileInfo.size()
+                + (isTable ? QFileInfo(baseName + QLatin1String(".gnuplot")).size() : 0);
+        if (totalSize > m_maximumSize) {
+            QFile::remove(fileInfo.absoluteFilePath());
+            if (isTable)
+                QFile::remove(baseName + QLatin1String(".gnuplot"));
+        }
+    }
+}
+
+/***************************************************************************/
+
+QString TikzGnuplotCache::cacheDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+            + QLatin1String("/gnuplot");
+}
+
+qint64 TikzGnuplotCache::size()
+{
+    qint64 totalSize = 0;
+    const QFileInfoList fileInfos = QDir(cacheDirectory()).entryInfoList(QDir::Files);
+    for (const auto &fileInfo : fileInfos)
+        totalSize += fileInfo.size();
+    return totalSize;
+}
+
+void TikzGnuplotCache::clear()
+{
+    QDir(cacheDirectory()).removeRecursively();
+}
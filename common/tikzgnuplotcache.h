@@ -0,0 +1,55 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#ifndef KTIKZ_TIKZGNUPLOTCACHE_H
+#define KTIKZ_TIKZGNUPLOTCACHE_H
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+/**
+ * Keeps the tables which gnuplot has computed for the plots in the TikZ
+ * code in the cache directory, so that gnuplot is not run again for the
+ * same plots after the temporary directory has been removed (e.g. in a new
+ * session).  Each table is stored together with its gnuplot script under a
+ * hash of that script.  For each set of plots, an index lists the files
+ * in which LaTeX expects these tables; PGF only reuses a restored table if
+ * the script it writes is identical to the restored one, so restoring a
+ * wrong table only costs a run of gnuplot.  When the cache grows larger
+ * than the maximum size, the least recently used tables are removed.
+ */
+class TikzGnuplotCache
+{
+public:
+    TikzGnuplotCache();
+
+    static QString key(const QString &latexCode, const QString &tikzCode);
+    void setMaximumSize(qint64 maximumSize);
+    int restore(const QString &key, const QString &workingDir);
+    void store(const QString &key, const QString &workingDir, const QStringList &flsFileNames);
+
+    static QString cacheDirectory();
+    static qint64 size();
+    static void clear();
+
+private:
+    void prune();
+
+    qint64 m_maximumSize;
+};
+
+#endif
@@ -0,0 +1,174 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#include "tikzlogscanner.h"
+
+struct KnownMessageText
+{
+    const char *text;
+    TikzLogScanner::Severity severity;
+};
+
+// the leftmost message in a line is used; "Undefined control sequence" is
+// not listed, because TeX reports it as a "! ..." or "file:line: ..." error
+static const KnownMessageText s_knownMessages[] = {
+    { "LaTeX Warning:", TikzLogScanner::Warning },
+    { "LaTeX Error:", TikzLogScanner::Error },
+    { "Runaway argument?", TikzLogScanner::Error },
+    { "Missing character:", TikzLogScanner::Warning },
+    { "Error:", TikzLogScanner::Error },
+};
+
+/*!
+ * Reads the decimal number starting at \p position in \p line and returns
+ * the position after it, or \p position if there is no number there.
+ */
+
+static int readNumber(const QStringRef &line, int position, int *number)
+{
+    *number = 0;
+    int i = position;
+    while (i < line.size() && line.at(i).isDigit()) {
+        *number = *number * 10 + line.at(i).digitValue();
+        ++i;
+    }
+    return i;
+}
+
+/*!
+ * Returns the index in s_knownMessages of the message which starts at
+ * \p position in \p line, or -1 if there is none.
+ */
+
+static int knownMessageAt(const QStringRef &line, int position)
+{
+    const QChar c = line.at(position);
+    for (int k = 0; k < int(sizeof(s_knownMessages) / sizeof(s_knownMessages[0])); ++k) {
+        const QLatin1String text(s_knownMessages[k].text);
+        if (text.at(0) == c && line.mid(position, text.size()) == text)
+            return k;
+    }
+    return -1;
+}
+
+/*!
+ * Returns true if \p line contains an error or warning, which is then
+ * described by \p diagnostic (with positions relative to \p line and
+ * logLine set to 0).
+ */
+
+bool TikzLogScanner::scanLine(const QStringRef &line, Diagnostic *diagnostic)
+{
+    const int size = line.size();
+    if (size == 0)
+        return false;
+
+    // "! message"
+    if (line.at(0) == QLatin1Char('!') && size > 1 && line.at(1) == QLatin1Char(' ')) {
+        *diagnostic = { TexError, Error, -1, 0, 0, 2, size - 2 };
+        return true;
+    }
+
+    // "[name] Line line: message"
+    if (line.at(0) == QLatin1Char('[')) {
+        const int end = line.indexOf(QLatin1String("] Line "));
+        if (end > 0) {
+            int sourceLine;
+            const int i = readNumber(line, end + 7, &sourceLine);
+            if (i > end + 7 && i + 1 < size && line.at(i) == QLatin1Char(':')
+                && line.at(i + 1) == QLatin1Char(' ')) {
+                *diagnostic = { GeneratedMessage, Error, sourceLine, 0, 0, i + 2, size - i - 2 };
+                return true;
+            }
+        }
+    }
+
+    // "file:line: message"; the file name is the text without white space
+    // before the first colon which is followed by a number, a colon and a
+    // space; the known messages are looked for in the same pass, but they
+    // are only used if the line is not of this form
+    int start = 0;
+    int knownMessage = -1;
+    int knownMessageOffset = 0;
+    for (int i = 0; i < size; ++i) {
+        const QChar c = line.at(i);
+        if (c.isSpace()) {
+            start = i + 1;
+            continue;
+        }
+        if (c == QLatin1Char(':')) {
+            int sourceLine;
+            const int j = readNumber(line, i + 1, &sourceLine);
+            if (j > i + 1 && j + 1 < size && line.at(j) == QLatin1Char(':')
+                && line.at(j + 1) == QLatin1Char(' ')) {
+                *diagnostic = { FileLineError, Error, sourceLine, 0, start, j + 2, size - j - 2 };
+                return true;
+            }
+        }
+        if (knownMessage < 0) {
+            knownMessage = knownMessageAt(line, i);
+            knownMessageOffset = i;
+        }
+    }
+
+    if (knownMessage < 0)
+        return false;
+    *diagnostic = { KnownMessage, s_knownMessages[knownMessage].severity, -1, 0,
+                    knownMessageOffset, knownMessageOffset, size - knownMessageOffset };
+    return true;
+}
+
+/*!
+ * Returns the errors and warnings in \p text in the order in which they
+ * occur, with positions relative to \p text.
+ */
+
+QVector<TikzLogScanner::Diagnostic> TikzLogScanner::scan(const QString &text)
+{
+    QVector<Diagnostic> diagnostics;
+    Diagnostic diagnostic;
+    int lineStart = 0;
+    for (int logLine = 0;; ++logLine) {
+        int lineEnd = text.indexOf(QLatin1Char('\n'), lineStart);
+        if (lineEnd < 0)
+            lineEnd = text.size();
+        if (scanLine(text.midRef(lineStart, lineEnd - lineStart), &diagnostic)) {
+            diagnostic.logLine = logLine;
+            diagnostic.offset += lineStart;
+            diagnostic.messageOffset += lineStart;
+            diagnostics << diagnostic;
+        }
+        if (lineEnd == text.size())
+            break;
+        lineStart = lineEnd + 1;
+    }
+    return diagnostics;
+}
+
+/*!
+ * Returns true if \p line is of the form "l.<number> ...", by which TeX
+ * shows the line in which an error occurred.  \p restOffset is set to the
+ * position after the number.
+ */
+
+bool TikzLogScanner::isLineReference(const QStringRef &line, int *sourceLine, int *restOffset)
+{
+    if (!line.startsWith(QLatin1String("l.")))
+        return false;
+    *restOffset = readNumber(line, 2, sourceLine);
+    return *restOffset > 2;
+}
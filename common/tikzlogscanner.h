@@ -0,0 +1,56 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#ifndef KTIKZ_TIKZLOGSCANNER_H
+#define KTIKZ_TIKZLOGSCANNER_H
+
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+/**
+ * Finds the errors and warnings in a LaTeX log in one pass over the text,
+ * without regular expressions, so that large logs (e.g. of pgfplots
+ * figures) can be parsed and highlighted quickly.
+ */
+class TikzLogScanner
+{
+public:
+    enum Kind {
+        FileLineError, ///< "file:line: message", as written with -file-line-error
+        TexError, ///< "! message"
+        KnownMessage, ///< a line containing a known error or warning text
+        GeneratedMessage ///< "[name] Line line: message", written by TikzPreviewGenerator
+    };
+    enum Severity { Error, Warning };
+
+    struct Diagnostic
+    {
+        Kind kind;
+        Severity severity;
+        int sourceLine; ///< the line in the LaTeX source, or -1 if unknown
+        int logLine; ///< the line in the scanned text, counting from 0
+        int offset; ///< the start of the diagnostic in the scanned text
+        int messageOffset; ///< the start of the message in the scanned text
+        int messageLength; ///< the length of the message (up to the end of the line)
+    };
+
+    static bool scanLine(const QStringRef &line, Diagnostic *diagnostic);
+    static QVector<Diagnostic> scan(const QString &text);
+    static bool isLineReference(const QStringRef &line, int *sourceLine, int *restOffset);
+};
+
+#endif
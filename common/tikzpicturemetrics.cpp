@@ -0,0 +1,94 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#include "tikzpicturemetrics.h"
+
+#include <QtCore/QFile>
+
+static const int s_formatVersion = 2; // written by LaTeX in the first line of the file
+
+/*!
+ * Returns the number of decimals needed to show significant digits (and not
+ * numbers like 0.00) of coordinates with unit length \p unit.
+ */
+
+static int bestPrecision(qreal unit)
+{
+    qreal invUnit = 1 / unit;
+    int precision = 0;
+    for (; invUnit < 1; ++precision)
+        invUnit *= 10;
+    return precision;
+}
+
+/*!
+ * Parses the .ktikzaux file \p tikzAuxFileName, which contains a line
+ * "unitx;unity;minx;maxx;miny;maxy;firstline;lastline" for each picture (and
+ * a version line starting with "%" for each run of LaTeX, since the files of
+ * separately compiled pictures are concatenated).  \p tikzCode is used to
+ * find the names of the pictures.  Returns an empty vector if the file does
+ * not exist or has been written in an unknown format.
+ */
+
+QVector<TikzPictureMetrics> TikzPictureMetrics::read(const QString &tikzAuxFileName,
+                                                     const QString &tikzCode)
+{
+    QVector<TikzPictureMetrics> metricsList;
+    QFile tikzAuxFile(tikzAuxFileName);
+    if (!tikzAuxFile.open(QIODevice::ReadOnly | QIODevice::Text))
+        return metricsList;
+    const QString tikzAux = QString::fromLatin1(tikzAuxFile.readAll());
+    tikzAuxFile.close();
+
+    const QVector<QStringRef> lines = tikzAux.splitRef(QLatin1Char('\n'), Qt::SkipEmptyParts);
+    metricsList.reserve(lines.size());
+    for (const auto &line : lines) {
+        if (line.startsWith(QLatin1Char('%'))) {
+            if (line.mid(line.indexOf(QLatin1Char(' ')) + 1).toInt() != s_formatVersion)
+                return QVector<TikzPictureMetrics>();
+            continue;
+        }
+        const QVector<QStringRef> fields = line.split(QLatin1Char(';'));
+        if (fields.size() < 8)
+            return QVector<TikzPictureMetrics>();
+        TikzPictureMetrics metrics;
+        metrics.unitX = fields.at(0).toDouble();
+        metrics.unitY = fields.at(1).toDouble();
+        metrics.minX = fields.at(2).toDouble();
+        metrics.maxX = fields.at(3).toDouble();
+        metrics.minY = fields.at(4).toDouble();
+        metrics.maxY = fields.at(5).toDouble();
+        metrics.precisionX = metrics.unitX > 0 ? bestPrecision(metrics.unitX) : 0;
+        metrics.precisionY = metrics.unitY > 0 ? bestPrecision(metrics.unitY) : 0;
+        metrics.firstLine = fields.at(6).toInt();
+        metrics.lastLine = fields.at(7).toInt();
+        if (metrics.firstLine <= 0 || metrics.lastLine < metrics.firstLine)
+            metrics.firstLine = metrics.lastLine = -1;
+        metricsList << metrics;
+    }
+
+    // a comment directly above a picture is used as its name
+    const QVector<QStringRef> codeLines = tikzCode.splitRef(QLatin1Char('\n'));
+    for (auto &metrics : metricsList) {
+        if (metrics.firstLine < 2 || metrics.firstLine - 2 >= codeLines.size())
+            continue;
+        const QStringRef commentLine = codeLines.at(metrics.firstLine - 2).trimmed();
+        if (commentLine.startsWith(QLatin1Char('%')))
+            metrics.name = commentLine.mid(1).trimmed().toString();
+    }
+    return metricsList;
+}
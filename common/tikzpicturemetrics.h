@@ -0,0 +1,51 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#ifndef KTIKZ_TIKZPICTUREMETRICS_H
+#define KTIKZ_TIKZPICTUREMETRICS_H
+
+#include <QtCore/QMetaType>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+/**
+ * The metrics of the picture on one page of the preview, as written by
+ * LaTeX to the .ktikzaux file at the end of each tikzpicture.  All lengths
+ * are in points.
+ */
+struct TikzPictureMetrics
+{
+    qreal unitX; // unit length in x-direction
+    qreal unitY; // unit length in y-direction
+    qreal minX; // bounding box of the picture
+    qreal maxX;
+    qreal minY;
+    qreal maxY;
+    int precisionX; // number of significant decimals of the x-coordinates
+    int precisionY;
+    int firstLine; // lines of the TikZ code containing the picture, -1 if unknown
+    int lastLine;
+    QString name; // taken from a comment just above the picture
+
+    static QVector<TikzPictureMetrics> read(const QString &tikzAuxFileName,
+                                            const QString &tikzCode);
+};
+
+Q_DECLARE_METATYPE(TikzPictureMetrics)
+Q_DECLARE_TYPEINFO(TikzPictureMetrics, Q_MOVABLE_TYPE);
+
+#endif
@@ -67,6 +67,8 @@ TikzPreview::TikzPreview(QWidget *parent)
     m_tikzPreviewRenderer = new TikzPreviewRenderer();
     connect(this, &TikzPreview::generatePreview, m_tikzPreviewRenderer,
             &TikzPreviewRenderer::generatePreview);
+    connect(this, &TikzPreview::generateSvgPreview, m_tikzPreviewRenderer,
+            &TikzPreviewRenderer::generateSvgPreview);
     connect(m_tikzPreviewRenderer, &TikzPreviewRenderer::showPreview, this,
             &TikzPreview::showPreview);
 }
@@ -217,21 +219,26 @@ void TikzPreview::showPreviousPage()
     if (m_currentPage > 0)
         --m_currentPage;
     m_previousPageAction->setEnabled(m_currentPage > 0);
-    m_nextPageAction->setEnabled(m_currentPage < m_tikzPdfDoc->numPages() - 1);
+    m_nextPageAction->setEnabled(m_currentPage < numberOfPages() - 1);
     showPdfPage();
 }
 
 void TikzPreview::showNextPage()
 {
-    if (m_currentPage < m_tikzPdfDoc->numPages() - 1)
+    if (m_currentPage < numberOfPages() - 1)
         ++m_currentPage;
     m_previousPageAction->setEnabled(m_currentPage > 0);
-    m_nextPageAction->setEnabled(m_currentPage < m_tikzPdfDoc->numPages() - 1);
+    m_nextPageAction->setEnabled(m_currentPage < numberOfPages() - 1);
     showPdfPage();
 }
 
-void TikzPreview::showPreview(const QImage &tikzImage, qreal zoomFactor)
+void TikzPreview::showPreview(const QImage &tikzImage, qreal zoomFactor, int request)
 {
+    // the image may have been queued before a newer page, zoom factor or
+    // document has been requested
+    if (!m_tikzPreviewRenderer->isLatestRequest(request))
+        return;
+
     // this slot is called when TikzPreviewRenderer has finished rendering
     // the current pdf page to tikzImage, so before we actually display
     // the image the old center point must be calculated and multiplied
@@ -254,19 +261,28 @@ void TikzPreview::showPreview(const QImage &tikzImage, qreal zoomFactor)
 
 void TikzPreview::showPdfPage()
 {
+    if (!m_svgPages.isEmpty()) {
+        if (!m_processRunning)
+            Q_EMIT generateSvgPreview(m_svgPages.at(m_currentPage), m_zoomFactor,
+                                      m_tikzPreviewRenderer->nextRequest());
+        return;
+    }
     if (!m_tikzPdfDoc || m_tikzPdfDoc->numPages() < 1)
         return;
 
+    // render the current pdf page to a QImage in TikzPreviewRenderer (in a
+    // different thread)
     if (!m_processRunning)
-        Q_EMIT generatePreview(m_tikzPdfDoc, m_zoomFactor,
-                               m_currentPage); // render the current pdf page to a QImage in
-                                               // TikzPreviewRenderer (in a different thread)
+        Q_EMIT generatePreview(m_tikzPdfDoc, m_zoomFactor, m_currentPage,
+                               m_tikzPreviewRenderer->nextRequest());
 }
 
 void TikzPreview::emptyPreview()
 {
+    m_tikzPreviewRenderer->nextRequest(); // drop the images which are still being rendered
     m_tikzPdfDoc = 0;
-    m_tikzCoordinates.clear();
+    m_svgPages.clear();
+    m_tikzPictureMetrics.clear();
     m_tikzPixmapItem->setPixmap(QPixmap());
     m_tikzPixmapItem->update();
     if (m_infoWidget)
@@ -278,10 +294,13 @@ void TikzPreview::emptyPreview()
     m_nextPageAction->setVisible(false);
 }
 
-void TikzPreview::pixmapUpdated(Poppler::Document *tikzPdfDoc, const QList<qreal> &tikzCoordinates)
+void TikzPreview::pixmapUpdated(Poppler::Document *tikzPdfDoc,
+                                const QVector<TikzPictureMetrics> &tikzPictureMetrics)
 {
+    m_tikzPreviewRenderer->nextRequest(); // the previous document may already be deleted
     m_tikzPdfDoc = tikzPdfDoc;
-    m_tikzCoordinates = tikzCoordinates;
+    m_svgPages.clear();
+    m_tikzPictureMetrics = tikzPictureMetrics;
 
     if (!m_tikzPdfDoc) {
         emptyPreview();
@@ -292,8 +311,35 @@ void TikzPreview::pixmapUpdated(Poppler::Document *tikzPdfDoc, const QList<qreal
     //	m_tikzPdfDoc->setRenderBackend(Poppler::Document::ArthurBackend);
     m_tikzPdfDoc->setRenderHint(Poppler::Document::Antialiasing, true);
     m_tikzPdfDoc->setRenderHint(Poppler::Document::TextAntialiasing, true);
-    const int numOfPages = m_tikzPdfDoc->numPages();
+    updatePageActions();
+    showPdfPage();
+}
+
+/*!
+ * Shows the fast preview, in which each page has been converted to SVG.
+ * The PDF document of the previous preview is no longer used; it is
+ * replaced when the PDF file for the current TikZ code is ready.
+ */
 
+void TikzPreview::svgUpdated(const QList<QByteArray> &svgPages,
+                             const QVector<TikzPictureMetrics> &tikzPictureMetrics)
+{
+    if (svgPages.isEmpty()) {
+        emptyPreview();
+        return;
+    }
+
+    m_tikzPreviewRenderer->nextRequest();
+    m_tikzPdfDoc = 0;
+    m_svgPages = svgPages;
+    m_tikzPictureMetrics = tikzPictureMetrics;
+    updatePageActions();
+    showPdfPage();
+}
+
+void TikzPreview::updatePageActions()
+{
+    const int numOfPages = numberOfPages();
     const bool visible = (numOfPages > 1);
     if (m_pageSeparator)
         m_pageSeparator->setVisible(visible);
@@ -308,14 +354,14 @@ void TikzPreview::pixmapUpdated(Poppler::Document *tikzPdfDoc, const QList<qreal
         m_previousPageAction->setEnabled(false);
         m_nextPageAction->setEnabled(true);
     }
-
-    showPdfPage();
 }
 
 /***************************************************************************/
 
 QImage TikzPreview::renderToImage(double xres, double yres, int pageNumber)
 {
+    if (!m_svgPages.isEmpty())
+        return TikzPreviewRenderer::renderSvgToImage(m_svgPages.at(pageNumber), xres, yres);
     Poppler::Page *page = m_tikzPdfDoc->page(pageNumber);
     //	const QSizeF pageSize = page->pageSizeF();
     //	const QImage image = pageSize.height() >= pageSize.width()
@@ -338,7 +384,9 @@ int TikzPreview::currentPage() const
 
 int TikzPreview::numberOfPages() const
 {
-    return m_tikzPdfDoc->numPages();
+    if (!m_svgPages.isEmpty())
+        return m_svgPages.size();
+    return m_tikzPdfDoc ? m_tikzPdfDoc->numPages() : 0;
 }
 
 /***************************************************************************/
@@ -415,43 +463,23 @@ void TikzPreview::wheelEvent(QWheelEvent *event)
 
 void TikzPreview::mouseMoveEvent(QMouseEvent *event)
 {
-    const int offset = 6 * m_currentPage;
-    if (m_showCoordinates && m_tikzCoordinates.length() >= offset + 6) {
-        const qreal unitX = m_tikzCoordinates.at(offset); // unit length in x-direction in points
-        const qreal unitY =
-                m_tikzCoordinates.at(1 + offset); // unit length in y-direction in points
-        const qreal minX =
-                m_tikzCoordinates.at(2 + offset); // minimum x-coordinate on the figure in points
-        const qreal maxX =
-                m_tikzCoordinates.at(3 + offset); // maximum x-coordinate on the figure in points
-        const qreal minY =
-                m_tikzCoordinates.at(4 + offset); // minimum y-coordinate on the figure in points
-        const qreal maxY =
-                m_tikzCoordinates.at(5 + offset); // maximum y-coordinate on the figure in points
-
-        if (unitX > 0 && unitY > 0) // this is not the case for 3D plots
+    if (m_showCoordinates && m_currentPage < m_tikzPictureMetrics.size()) {
+        const TikzPictureMetrics &metrics = m_tikzPictureMetrics.at(m_currentPage);
+        if (metrics.unitX > 0 && metrics.unitY > 0) // this is not the case for 3D plots
         {
-            int precisionX = m_precision; // the number of decimals used to display the x-coordinate
-                                          // of the mouse pointer
-            int precisionY = m_precision; // idem for the y-coordinate
-            if (m_precision < 0) // in app/configgeneralwidget.cpp the precision is set to -1 if the
-                                 // user chooses "Best precision", which we calculate now
-            {
-                qreal invUnitX = 1 / unitX;
-                qreal invUnitY = 1 / unitY;
-                for (precisionX = 0; invUnitX < 1;
-                     ++precisionX) // make sure that some significant decimals are displayed (and
-                                   // not numbers like 0.00)
-                    invUnitX *= 10;
-                for (precisionY = 0; invUnitY < 1; ++precisionY) // idem
-                    invUnitY *= 10;
-            }
+            // in app/configgeneralwidget.cpp the precision is set to -1 if the
+            // user chooses "Best precision", which has been calculated when
+            // the metrics were read
+            const int precisionX = m_precision < 0 ? metrics.precisionX : m_precision;
+            const int precisionY = m_precision < 0 ? metrics.precisionY : m_precision;
 
             const QPointF mouseSceneCoords = mapToScene(event->pos()) / m_zoomFactor;
-            const qreal coordX = mouseSceneCoords.x() + minX;
-            const qreal coordY = maxY - mouseSceneCoords.y();
-            if (coordX >= minX && coordX <= maxX && coordY >= minY && coordY <= maxY)
-                Q_EMIT showMouseCoordinates(coordX / unitX, coordY / unitY, precisionX, precisionY);
+            const qreal coordX = mouseSceneCoords.x() + metrics.minX;
+            const qreal coordY = metrics.maxY - mouseSceneCoords.y();
+            if (coordX >= metrics.minX && coordX <= metrics.maxX && coordY >= metrics.minY
+                && coordY <= metrics.maxY)
+                Q_EMIT showMouseCoordinates(coordX / metrics.unitX, coordY / metrics.unitY,
+                                            precisionX, precisionY);
         }
     }
     QGraphicsView::mouseMoveEvent(event);
@@ -22,6 +22,7 @@
 #include <QtCore/QtGlobal>
 #include <QtWidgets/QGraphicsView>
 
+#include "tikzpicturemetrics.h"
 #include "tikzpreviewmessagewidget.h"
 
 class QToolBar;
@@ -57,14 +58,19 @@ public:
     void setBackgroundColor(QColor color);
 
 public Q_SLOTS:
-    void showPreview(const QImage &tikzImage, qreal zoomFactor = 1.0);
+    void showPreview(const QImage &tikzImage, qreal zoomFactor, int request);
     void pixmapUpdated(Poppler::Document *tikzPdfDoc,
-                       const QList<qreal> &tikzCoordinates = QList<qreal>());
+                       const QVector<TikzPictureMetrics> &tikzPictureMetrics =
+                               QVector<TikzPictureMetrics>());
+    void svgUpdated(const QList<QByteArray> &svgPages,
+                    const QVector<TikzPictureMetrics> &tikzPictureMetrics);
     void showErrorMessage(const QString &message);
 
 Q_SIGNALS:
     void showMouseCoordinates(qreal x, qreal y, int precisionX = 5, int precisionY = 5);
-    void generatePreview(Poppler::Document *tikzPdfDoc, qreal zoomFactor, int currentPage);
+    void generatePreview(Poppler::Document *tikzPdfDoc, qreal zoomFactor, int currentPage,
+                         int request);
+    void generateSvgPreview(const QByteArray &svgData, qreal zoomFactor, int request);
 
 protected:
     void contextMenuEvent(QContextMenuEvent *event) override;
@@ -84,6 +90,7 @@ private:
     void createInformationLabel();
     void createActions();
     void showPdfPage();
+    void updatePageActions();
     void centerInfoLabel();
     void setInfoLabelText(const QString &message,
                           TikzPreviewMessageWidget::PixmapVisibility pixmapVisibility =
@@ -104,13 +111,14 @@ private:
     TikzPreviewMessageWidget *m_infoWidget;
 
     Poppler::Document *m_tikzPdfDoc;
+    QList<QByteArray> m_svgPages; // the fast preview, shown until the PDF file is ready
     int m_currentPage;
     qreal m_zoomFactor;
     qreal m_oldZoomFactor;
     bool m_hasZoomed;
 
     bool m_showCoordinates;
-    QList<qreal> m_tikzCoordinates;
+    QVector<TikzPictureMetrics> m_tikzPictureMetrics; // one for each page of m_tikzPdfDoc
     int m_precision;
 };
 
@@ -24,6 +24,9 @@
 #  include <QtWidgets/QToolBar>
 #endif
 
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QFileSystemWatcher>
+#include <QtCore/QRegularExpression>
 #include <QtCore/QSettings>
 #include <QtCore/QTimer>
 #include <QtCore/QPointer>
@@ -36,6 +39,7 @@
 #include <poppler-qt5.h>
 
 #include "templatewidget.h"
+#include "tikzcompilescheduler.h"
 #include "tikzpreview.h"
 #include "mainwidget.h"
 #include "utils/action.h"
@@ -48,9 +52,16 @@
 #include "utils/tempdir.h"
 #include "utils/toggleaction.h"
 
-static const int s_minUpdateInterval = 1000; // 1 sec
+static const int s_defaultUpdateInterval = 1000; // 1 sec, used until a compile time is measured
+static const int s_maxEditInterval = 2000; // longer pauses between edits are not typing
+static const qreal s_smoothingFactor = 0.3; // weight of the newest measurement
+static const int s_dependencyChangeDelay = 500; // an editor may save a file in several steps
 
 TikzPreviewController::TikzPreviewController(MainWidget *mainWidget)
+    : m_compileTimeEstimate(-1),
+      m_editIntervalEstimate(-1),
+      m_minUpdateInterval(250),
+      m_maxUpdateInterval(5000)
 {
     m_mainWidget = mainWidget;
     m_parentWidget = m_mainWidget->widget();
@@ -62,9 +73,11 @@ TikzPreviewController::TikzPreviewController(MainWidget *mainWidget)
 
     createActions();
 
-    qRegisterMetaType<QList<qreal>>("QList<qreal>");
+    qRegisterMetaType<QVector<TikzPictureMetrics>>("QVector<TikzPictureMetrics>");
     connect(m_tikzPreviewGenerator, &TikzPreviewGenerator::pixmapUpdated, m_tikzPreview,
             &TikzPreview::pixmapUpdated);
+    connect(m_tikzPreviewGenerator, &TikzPreviewGenerator::svgUpdated, m_tikzPreview,
+            &TikzPreview::svgUpdated);
     connect(m_tikzPreviewGenerator, &TikzPreviewGenerator::showErrorMessage, m_tikzPreview,
             &TikzPreview::showErrorMessage);
     connect(m_tikzPreviewGenerator, &TikzPreviewGenerator::setExportActionsEnabled, this,
@@ -73,6 +86,10 @@ TikzPreviewController::TikzPreviewController(MainWidget *mainWidget)
             &TikzPreviewController::updateLog);
     connect(m_tikzPreviewGenerator, &TikzPreviewGenerator::appendLog, this,
             &TikzPreviewController::appendLog);
+    connect(m_tikzPreviewGenerator, &TikzPreviewGenerator::compilationFinished, this,
+            &TikzPreviewController::updateCompileTimeEstimate);
+    connect(m_tikzPreviewGenerator, &TikzPreviewGenerator::previewFinished, this,
+            &TikzPreviewController::showPreviewJobCounts);
     connect(m_templateWidget, &TemplateWidget::fileNameChanged, this,
             &TikzPreviewController::setTemplateFileAndRegenerate);
     connect(m_tikzPreview, &TikzPreview::showMouseCoordinates, this,
@@ -82,7 +99,26 @@ TikzPreviewController::TikzPreviewController(MainWidget *mainWidget)
     m_regenerateTimer->setSingleShot(true);
     connect(m_regenerateTimer, &QTimer::timeout, this, &TikzPreviewController::regeneratePreview);
 
-    m_tempDir = new TempDir();
+    m_dependencyWatcher = new QFileSystemWatcher(this);
+    m_dependencyTimer = new QTimer(this);
+    m_dependencyTimer->setSingleShot(true);
+    connect(m_tikzPreviewGenerator, &TikzPreviewGenerator::dependenciesChanged, this,
+            &TikzPreviewController::watchDependencies);
+    connect(m_dependencyWatcher, &QFileSystemWatcher::fileChanged, this,
+            &TikzPreviewController::regeneratePreviewAfterDependencyChange);
+    connect(m_dependencyTimer, &QTimer::timeout, this, &TikzPreviewController::regeneratePreview);
+
+    // a workspace in memory avoids the latency of slow or encrypted disks
+    QSettings settings;
+    const QString memoryBackedTemplatePath =
+            settings.value(QLatin1String("Preview/UseMemoryWorkspace"), false).toBool()
+            ? TempDir::memoryBackedTemplatePath()
+            : QString();
+    m_tempDir = new TempDir(memoryBackedTemplatePath);
+    if (!memoryBackedTemplatePath.isEmpty() && !m_tempDir->isValid()) {
+        delete m_tempDir;
+        m_tempDir = new TempDir();
+    }
     m_tikzPreviewGenerator->setTikzFileBaseName(tempFileBaseName());
 #ifdef KTIKZ_USE_KDE
     File::setMainWidget(m_parentWidget);
@@ -217,6 +253,18 @@ void TikzPreviewController::createActions()
     connect(m_shellEscapeAction, &ToggleAction::toggled, this,
             &TikzPreviewController::toggleShellEscaping);
 
+    m_fastPreviewAction = new ToggleAction(Icon(QLatin1String("view-preview")),
+                                           tr("&Fast Preview"), m_parentWidget,
+                                           QLatin1String("fast_preview"));
+    m_fastPreviewAction->setStatusTip(tr("Show a preview compiled to DVI before the PDF file"));
+    m_fastPreviewAction->setWhatsThis(tr(
+            "<p>Compile the TikZ code to DVI with latex or dvilualatex and show the result, "
+            "converted to SVG with dvisvgm, before the PDF file is ready.  For simple pictures "
+            "this shows the preview sooner.  The PDF file is still used for exporting and "
+            "printing.</p><p>This setting is remembered for each document.</p>"));
+    connect(m_fastPreviewAction, &ToggleAction::toggled, this,
+            &TikzPreviewController::toggleFastPreview);
+
     connect(m_tikzPreviewGenerator, &TikzPreviewGenerator::processRunning, this,
             &TikzPreviewController::setProcessRunning);
 }
@@ -244,6 +292,7 @@ QMenu *TikzPreviewController::menu()
     viewMenu->addSeparator();
     viewMenu->addAction(m_procStopAction);
     viewMenu->addAction(m_shellEscapeAction);
+    viewMenu->addAction(m_fastPreviewAction);
     return viewMenu;
 }
 
@@ -303,30 +352,38 @@ void TikzPreviewController::exportImage()
     if (!exportUrl.isValid())
         return;
 
-    QString extension;
+    // the file is written in its own slot, so that it is not replaced when
+    // the preview is regenerated in the meantime
+    const QString slotDir = m_tikzPreviewGenerator->createSlot(QLatin1String("export"));
+    if (slotDir.isEmpty()) {
+        MessageBox::error(m_parentWidget, tr("Export failed."),
+                          QCoreApplication::applicationName());
+        return;
+    }
+    QString exportFileName = slotDir + QLatin1Char('/')
+            + QFileInfo(tempFileBaseName()).fileName();
+    bool success;
     if (mimeType == QLatin1String("application/pdf")) {
-        extension = QLatin1String(".pdf");
+        exportFileName += QLatin1String(".pdf");
+        success = m_tikzPreviewGenerator->writePdfFile(exportFileName);
     } else if (mimeType == QLatin1String("image/x-eps")) {
-        if (!m_tikzPreviewGenerator->generateEpsFile(m_tikzPreview->currentPage())) {
-            MessageBox::error(m_parentWidget, tr("Export failed."),
-                              QCoreApplication::applicationName());
-            return;
-        }
-        extension = QLatin1String(".eps");
+        exportFileName += QLatin1String(".eps");
+        success = m_tikzPreviewGenerator->generateEpsFile(m_tikzPreview->currentPage(),
+                                                           exportFileName);
     } else {
-        extension = QLatin1Char('.') + mimeType.mid(6);
-        if (!tikzImage.save(tempFileBaseName() + extension)) {
-            MessageBox::error(m_parentWidget, tr("Export failed."),
-                              QCoreApplication::applicationName());
-            return;
-        }
+        exportFileName += QLatin1Char('.') + mimeType.mid(6);
+        success = tikzImage.save(exportFileName);
     }
 
-    if (!File::copy(Url(tempFileBaseName() + extension), exportUrl))
+    if (!success)
+        MessageBox::error(m_parentWidget, tr("Export failed."),
+                          QCoreApplication::applicationName());
+    else if (!File::copy(Url(exportFileName), exportUrl))
         MessageBox::error(
                 m_parentWidget,
                 tr("The image could not be exported to the file \"%1\".").arg(exportUrl.path()),
                 QCoreApplication::applicationName());
+    m_tikzPreviewGenerator->releaseSlot(slotDir);
 }
 
 /***************************************************************************/
@@ -452,13 +509,65 @@ void TikzPreviewController::generatePreview()
     generatePreview(TikzPreviewGenerator::ReloadTemplate);
 }
 
+/*!
+ * Returns a hash of \p tikzCode which does not change when only comments
+ * or the amount of white space are changed, since these changes do not
+ * affect the picture.  A comment also removes the end of its line (but an
+ * empty line after it is still a paragraph break), so this is kept in the
+ * normalized code.  Code in which the end of a line or a \c % may mean
+ * something else (verbatim text, changed category codes) is hashed as is.
+ */
+
+static QByteArray normalizedFingerprint(const QString &tikzCode)
+{
+    static const QRegularExpression verbatimRegExp(
+            QLatin1String("\\\\(verb|catcode|url|"
+                          "begin\\{(verbatim|lstlisting|minted|filecontents))"));
+    if (tikzCode.contains(verbatimRegExp))
+        return QCryptographicHash::hash(tikzCode.toUtf8(), QCryptographicHash::Sha1);
+
+    QString normalized;
+    normalized.reserve(tikzCode.size());
+    const int size = tikzCode.size();
+    bool hasSpace = false; // white space has been skipped since the last character
+    int newlineCount = 0; // number of line ends in that white space
+    bool afterComment = false; // the previous line end has been removed by a comment
+    for (int i = 0; i < size; ++i) {
+        const QChar c = tikzCode.at(i);
+        if (c == QLatin1Char('%')) {
+            // skip the comment, its line end and the indentation of the next line
+            while (i + 1 < size && tikzCode.at(i + 1) != QLatin1Char('\n'))
+                ++i;
+            ++i;
+            while (i + 1 < size
+                   && (tikzCode.at(i + 1) == QLatin1Char(' ')
+                       || tikzCode.at(i + 1) == QLatin1Char('\t')))
+                ++i;
+            afterComment = true;
+            continue;
+        }
+        if (c.isSpace()) {
+            if (c == QLatin1Char('\n'))
+                newlineCount += afterComment ? 2 : 1; // after a comment, the line is empty
+            hasSpace = true;
+            continue;
+        }
+        if (hasSpace)
+            normalized += newlineCount >= 2 ? QLatin1String("\n\n") : QLatin1String(" ");
+        hasSpace = false;
+        newlineCount = 0;
+        afterComment = false;
+        normalized += c;
+        if (c == QLatin1Char('\\') && i + 1 < size)
+            normalized += tikzCode.at(++i); // e.g. \% is not a comment
+    }
+    return QCryptographicHash::hash(normalized.toUtf8(), QCryptographicHash::Sha1);
+}
+
 void TikzPreviewController::generatePreview(TikzPreviewGenerator::TemplateStatus templateStatus)
 {
-    if (templateStatus
-        == TikzPreviewGenerator::ReloadTemplate) // old aux files may contain commands available in
-                                                 // the old template, but not anymore in the new
-                                                 // template
-        m_tempDir->cleanUp();
+    // when the template is reloaded, the generator removes the files which
+    // depend on the template, but only if the template has really changed
 
     // the directory in which the pgf file is located is added to TEXINPUTS (and the directory of
     // the old pgf file is removed) before running latex
@@ -466,14 +575,35 @@ void TikzPreviewController::generatePreview(TikzPreviewGenerator::TemplateStatus
     if (!m_currentFileName.isEmpty() && currentFileName != m_currentFileName)
         m_tikzPreviewGenerator->removeFromLatexSearchPath(
                 QFileInfo(m_currentFileName).absolutePath());
+    if (currentFileName != m_currentFileName) {
+        // the compile time of another document says nothing about this one
+        m_compileTimeEstimate = -1;
+        m_editIntervalEstimate = -1;
+        m_editTimer.invalidate();
+        m_tikzPreviewGenerator->setCompileTimeEstimate(m_compileTimeEstimate);
+
+        // the preview engine is chosen for each document; a new document
+        // keeps the fast preview if it has been enabled before saving it
+        if (!currentFileName.isEmpty()) {
+            QSettings settings(QString::fromLocal8Bit(ORGNAME), QString::fromLocal8Bit(APPNAME));
+            const QStringList fastPreviewFiles =
+                    settings.value(QLatin1String("Preview/FastPreviewFiles")).toStringList();
+            if (m_currentFileName.isEmpty() && m_fastPreviewAction->isChecked())
+                settings.setValue(QLatin1String("Preview/FastPreviewFiles"),
+                                  QStringList(fastPreviewFiles) << currentFileName);
+            else
+                setFastPreview(fastPreviewFiles.contains(currentFileName));
+        }
+    }
     m_currentFileName = currentFileName;
     if (!currentFileName.isEmpty())
         m_tikzPreviewGenerator->addToLatexSearchPath(QFileInfo(currentFileName).absolutePath());
 
-    m_tikzPreviewGenerator->abortProcess(); // abort still running process before starting a new one
-                                            // (without this, if a process hangs, all subsequently
-                                            // started processes are executed one after the other
-                                            // when the user aborts the hanging process)
+    m_compiledFingerprint = normalizedFingerprint(tikzCode());
+    m_tikzPreviewGenerator->setForeground(m_parentWidget->window()->isActiveWindow());
+    // the generator aborts the running process unless it is nearly finished;
+    // only the latest request is handled after it, so that hanging processes
+    // do not cause a queue of requests
     m_tikzPreviewGenerator->generatePreview(templateStatus);
 }
 
@@ -488,11 +618,95 @@ void TikzPreviewController::regeneratePreviewAfterDelay()
         m_tikzPreview->pixmapUpdated(0); // clean up error messages in preview
         Q_EMIT updateLog(QString(), false); // clean up error messages in log panel
     }
+
+    if (m_editTimer.isValid()) {
+        const qint64 editInterval = m_editTimer.restart();
+        if (editInterval < s_maxEditInterval)
+            m_editIntervalEstimate = m_editIntervalEstimate < 0
+                    ? editInterval
+                    : (1 - s_smoothingFactor) * m_editIntervalEstimate
+                            + s_smoothingFactor * editInterval;
+    } else
+        m_editTimer.start();
+
+    // an edit which does not change the picture (or which restores the code
+    // of the last run) does not require a new run, unless the line numbers
+    // of the errors in the log must be updated
+    if (normalizedFingerprint(tikzCode()) == m_compiledFingerprint
+        && !m_tikzPreviewGenerator->hasRunFailed()) {
+        m_regenerateTimer->stop();
+        return;
+    }
+
     // Each start cancels the previous one, this means that timeout() is only
     // fired when there have been no changes in the text editor for the last
-    // s_minUpdateInterval msecs. This ensures that the preview is not
+    // updateInterval() msecs. This ensures that the preview is not
     // regenerated on every character that is added/changed/removed.
-    m_regenerateTimer->start(s_minUpdateInterval);
+    const int interval = updateInterval();
+    m_regenerateTimer->start(interval);
+    Q_EMIT showStatusMessage(tr("Preview update delay: %1 ms").arg(interval), 2000);
+}
+
+/*!
+ * Watches the files (data tables, styles, ...) which LaTeX has read while
+ * compiling the TikZ code, so that the preview is also updated when one of
+ * them is changed in another program.
+ */
+
+void TikzPreviewController::watchDependencies(const QStringList &dependencies)
+{
+    const QStringList watchedFiles = m_dependencyWatcher->files();
+    if (!watchedFiles.isEmpty())
+        m_dependencyWatcher->removePaths(watchedFiles);
+    if (!dependencies.isEmpty())
+        m_dependencyWatcher->addPaths(dependencies);
+}
+
+void TikzPreviewController::regeneratePreviewAfterDependencyChange(const QString &path)
+{
+    // a file that is saved by replacing it is no longer watched
+    if (!m_dependencyWatcher->files().contains(path) && QFileInfo::exists(path))
+        m_dependencyWatcher->addPath(path);
+    if (!tikzCode().isEmpty())
+        m_dependencyTimer->start(s_dependencyChangeDelay);
+}
+
+/*!
+ * Returns the time that the preview generation waits after the last edit.
+ * Waiting somewhat longer than the usual pause between two keystrokes
+ * avoids starting LaTeX while typing, and waiting a fraction of the compile
+ * time avoids killing a slow compilation over and over again.
+ */
+
+int TikzPreviewController::updateInterval() const
+{
+    if (m_compileTimeEstimate < 0)
+        return qBound(m_minUpdateInterval, s_defaultUpdateInterval, m_maxUpdateInterval);
+    const qreal interval = qMax(1.5 * m_editIntervalEstimate, 0.25 * m_compileTimeEstimate);
+    return qBound(m_minUpdateInterval, qRound(interval), m_maxUpdateInterval);
+}
+
+void TikzPreviewController::updateCompileTimeEstimate(int elapsedTime)
+{
+    m_compileTimeEstimate = m_compileTimeEstimate < 0
+            ? elapsedTime
+            : (1 - s_smoothingFactor) * m_compileTimeEstimate + s_smoothingFactor * elapsedTime;
+    m_tikzPreviewGenerator->setCompileTimeEstimate(m_compileTimeEstimate);
+}
+
+/*!
+ * Shows in the status bar how many preview jobs have been completed, how
+ * many have been aborted by later edits and how many have been skipped
+ * because they were superseded before they were started.
+ */
+
+void TikzPreviewController::showPreviewJobCounts()
+{
+    Q_EMIT showStatusMessage(tr("Preview jobs: %1 completed, %2 aborted, %3 skipped")
+                                     .arg(m_tikzPreviewGenerator->completedJobCount())
+                                     .arg(m_tikzPreviewGenerator->abortedJobCount())
+                                     .arg(m_tikzPreviewGenerator->coalescedJobCount()),
+                             2000);
 }
 
 void TikzPreviewController::emptyPreview()
@@ -500,6 +714,7 @@ void TikzPreviewController::emptyPreview()
     setExportActionsEnabled(false);
     m_tikzPreviewGenerator->abortProcess(); // abort still running processes
     m_tikzPreview->emptyPreview();
+    m_compiledFingerprint.clear();
 }
 
 void TikzPreviewController::abortProcess()
@@ -511,6 +726,7 @@ void TikzPreviewController::abortProcess()
     // the process in the main thread by calling m_tikzPreviewGenerator->abortProcess()
     // as a regular (non-slot) function.
     m_tikzPreviewGenerator->abortProcess();
+    m_compiledFingerprint.clear(); // the aborted run has not updated the preview
 }
 
 /***************************************************************************/
@@ -522,6 +738,8 @@ void TikzPreviewController::applySettings()
             settings.value(QLatin1String("LatexCommand"), QLatin1String("pdflatex")).toString());
     m_tikzPreviewGenerator->setPdftopsCommand(
             settings.value(QLatin1String("PdftopsCommand"), QLatin1String("pdftops")).toString());
+    m_tikzPreviewGenerator->setDvisvgmCommand(
+            settings.value(QLatin1String("DvisvgmCommand"), QLatin1String("dvisvgm")).toString());
     const bool useShellEscaping = settings.value(QLatin1String("UseShellEscaping"), false).toBool();
 
     disconnect(m_shellEscapeAction, &Action::toggled, this,
@@ -547,6 +765,35 @@ void TikzPreviewController::applySettings()
     m_tikzPreview->setBackgroundColor(
             settings.value(QLatin1String("PreviewBackgroundColor"), QColor(0, 0, 0))
                     .value<QColor>());
+    m_tikzPreviewGenerator->setUsePreambleFormat(
+            settings.value(QLatin1String("UsePreambleFormat"), true).toBool());
+    m_tikzPreviewGenerator->setUseResidentWorker(
+            settings.value(QLatin1String("UseResidentWorker"), false).toBool());
+    m_tikzPreviewGenerator->setUseIncrementalCompilation(
+            settings.value(QLatin1String("IncrementalCompilation"), false).toBool());
+    m_tikzPreviewGenerator->setUseCompileCache(
+            settings.value(QLatin1String("UseCompileCache"), true).toBool());
+    m_tikzPreviewGenerator->setCompileCacheSize(
+            settings.value(QLatin1String("CompileCacheSize"), 100).toLongLong() * 1024 * 1024);
+    m_tikzPreviewGenerator->setFinishFraction(
+            settings.value(QLatin1String("LetCompilationFinish"), true).toBool()
+                    ? settings.value(QLatin1String("LetCompilationFinishPercentage"), 50).toInt()
+                            / 100.0
+                    : -1);
+    TikzCompileScheduler::instance()->setMaximumRunningCount(
+            settings.value(QLatin1String("MaximumConcurrentCompilations"), 0).toInt());
+    m_tikzPreviewGenerator->setAbortOnFirstError(
+            settings.value(QLatin1String("AbortOnFirstError"), false).toBool());
+    m_tikzPreviewGenerator->setResourceLimits(
+            settings.value(QLatin1String("CpuTimeLimit"), 0).toInt(),
+            settings.value(QLatin1String("MemoryLimit"), 0).toInt(),
+            settings.value(QLatin1String("TimeLimit"), 0).toInt());
+    m_tikzPreviewGenerator->setUseDraftPreCheck(
+            settings.value(QLatin1String("DraftPreCheck"), false).toBool());
+    m_minUpdateInterval = settings.value(QLatin1String("MinimumUpdateInterval"), 250).toInt();
+    m_maxUpdateInterval =
+            qMax(m_minUpdateInterval,
+                 settings.value(QLatin1String("MaximumUpdateInterval"), 5000).toInt());
     settings.endGroup();
 }
 
@@ -577,3 +824,33 @@ void TikzPreviewController::toggleShellEscaping(bool useShellEscaping)
     m_tikzPreviewGenerator->setShellEscaping(useShellEscaping);
     generatePreview(TikzPreviewGenerator::DontReloadTemplate);
 }
+
+void TikzPreviewController::setFastPreview(bool useFastPreview)
+{
+    disconnect(m_fastPreviewAction, &Action::toggled, this,
+               &TikzPreviewController::toggleFastPreview);
+    m_fastPreviewAction->setChecked(useFastPreview);
+    connect(m_fastPreviewAction, &Action::toggled, this,
+            &TikzPreviewController::toggleFastPreview);
+    m_tikzPreviewGenerator->setPreviewEngine(useFastPreview
+                                                     ? TikzPreviewGenerator::FastPreviewEngine
+                                                     : TikzPreviewGenerator::PdfEngine);
+}
+
+void TikzPreviewController::toggleFastPreview(bool useFastPreview)
+{
+    if (!m_currentFileName.isEmpty()) {
+        QSettings settings(QString::fromLocal8Bit(ORGNAME), QString::fromLocal8Bit(APPNAME));
+        QStringList fastPreviewFiles =
+                settings.value(QLatin1String("Preview/FastPreviewFiles")).toStringList();
+        fastPreviewFiles.removeAll(m_currentFileName);
+        if (useFastPreview)
+            fastPreviewFiles << m_currentFileName;
+        settings.setValue(QLatin1String("Preview/FastPreviewFiles"), fastPreviewFiles);
+    }
+
+    m_tikzPreviewGenerator->setPreviewEngine(useFastPreview
+                                                     ? TikzPreviewGenerator::FastPreviewEngine
+                                                     : TikzPreviewGenerator::PdfEngine);
+    generatePreview(TikzPreviewGenerator::DontReloadTemplate);
+}
@@ -21,6 +21,7 @@
 #ifndef KTIKZ_TIKZPREVIEWCONTROLLER_H
 #define KTIKZ_TIKZPREVIEWCONTROLLER_H
 
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QObject>
 #include "tikzpreviewgenerator.h"
 #include "utils/url.h"
@@ -31,6 +32,7 @@ class QMenu;
 class QToolBar;
 #endif
 
+class QFileSystemWatcher;
 class QPrinter;
 class QTimer;
 class TextCodecProfile;
@@ -83,11 +85,17 @@ private Q_SLOTS:
     void setExportActionsEnabled(bool enabled);
     void setProcessRunning(bool isRunning);
     void toggleShellEscaping(bool useShellEscaping);
+    void toggleFastPreview(bool useFastPreview);
+    void updateCompileTimeEstimate(int elapsedTime);
+    void showPreviewJobCounts();
+    void watchDependencies(const QStringList &dependencies);
+    void regeneratePreviewAfterDependencyChange(const QString &path);
 
 Q_SIGNALS:
     void updateLog(const QString &logText, bool runFailed);
     void appendLog(const QString &logText, bool runFailed);
     void showMouseCoordinates(qreal x, qreal y, int precisionX, int precisionY);
+    void showStatusMessage(const QString &message, int timeout);
 
 private:
     const QString tempFileBaseName() const;
@@ -95,6 +103,8 @@ private:
     void generatePreview(TikzPreviewGenerator::TemplateStatus templateStatus);
     bool setTemplateFile(const QString &path);
     Url getExportUrl(const Url &url, const QString &mimeType) const;
+    int updateInterval() const;
+    void setFastPreview(bool useFastPreview);
 
     MainWidget *m_mainWidget;
     QWidget *m_parentWidget;
@@ -104,6 +114,14 @@ private:
     TikzPreviewGenerator *m_tikzPreviewGenerator;
 
     QTimer *m_regenerateTimer;
+    QByteArray m_compiledFingerprint; // of the TikZ code of the last requested run
+    QFileSystemWatcher *m_dependencyWatcher; // watches the files read by LaTeX
+    QTimer *m_dependencyTimer;
+    QElapsedTimer m_editTimer;
+    qreal m_compileTimeEstimate; // in msec, negative if not yet measured
+    qreal m_editIntervalEstimate; // in msec, negative if not yet measured
+    int m_minUpdateInterval;
+    int m_maxUpdateInterval;
 
 #ifndef KTIKZ_USE_KDE
     QList<QToolBar *> m_toolBars;
@@ -113,6 +131,7 @@ private:
     Action *m_printAction;
     Action *m_procStopAction;
     ToggleAction *m_shellEscapeAction;
+    ToggleAction *m_fastPreviewAction;
 
     TempDir *m_tempDir;
     QString m_currentFileName;
@@ -25,15 +25,31 @@
 #ifdef KTIKZ_USE_KDE
 #  include <KFileItem>
 #endif
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
 #include <QtCore/QDebug>
 #include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QEventLoop>
 #include <QtCore/QProcess>
+#include <QtCore/QRegularExpression>
 #include <QtCore/QTextStream>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
 #include <QtGui/QPixmap>
 #include <QtCore/QStandardPaths>
+#include <QtCore/QTextCodec>
 #include <QtWidgets/QPlainTextEdit>
 #include <poppler-qt5.h>
 
+#include "tikzcompilecache.h"
+#include "tikzcompilescheduler.h"
+#include "tikzepsconverter.h"
+#include "tikzformatcache.h"
+#include "tikzgnuplotcache.h"
+#include "tikzlogscanner.h"
+#include "tikzpicturemetrics.h"
+#include "tikzprocess.h"
 #include "tikzpreviewcontroller.h"
 #include "mainwidget.h"
 #include "utils/file.h"
@@ -44,20 +60,36 @@ static const QChar s_pathSeparator = QLatin1Char(';');
 static const QChar s_pathSeparator = QLatin1Char(':');
 #endif
 
+static const int s_maxProcessOutputSize = 1024 * 1024; // only the last MiB of output is kept
+static const int s_maxLatexPasses = 3; // LaTeX is rerun at most twice to get positions right
+static const int s_maxSlotAge = 60 * 60; // in seconds, older slots have been left behind
+static const int s_pdftopsTimeLimit = 60; // in seconds, if no time limit is configured
+
 TikzPreviewGenerator::TikzPreviewGenerator(TikzPreviewController *parent)
     : m_parent(parent),
       m_tikzPdfDoc(0),
       m_process(0),
       m_processAborted(false),
-      m_runFailed(false),
+      m_processCrashed(false),
+      m_isForeground(true),
+      m_workerProcess(0),
+      m_generating(false),
+      m_hasPendingRequest(false),
+      m_compileStartTime(-1),
+      m_compileTimeEstimate(-1),
+      m_finishFraction(-1),
+      m_runFailed(0),
+      m_firstErrorShown(false),
+      m_stoppedAtFirstError(false),
+      m_limitExceeded(false),
       m_firstRun(true),
+      m_settings(std::make_shared<Settings>()),
       m_templateChanged(true) // is set correctly in generatePreviewImpl()
-      ,
-      m_useShellEscaping(false) // is set in setShellEscaping() at startup
 {
-    qRegisterMetaType<TemplateStatus>("TemplateStatus"); // needed for Q_ARG below
-
-    m_processEnvironment = QProcessEnvironment::systemEnvironment();
+    m_formatCache = new TikzFormatCache(this); // must be created before moving to m_thread
+    m_compileCache = new TikzCompileCache;
+    m_gnuplotCache = new TikzGnuplotCache;
+    m_clock.start();
 
     moveToThread(&m_thread);
     m_thread.start();
@@ -72,34 +104,133 @@ TikzPreviewGenerator::~TikzPreviewGenerator()
     }
     //	Q_EMIT processRunning(false); // this causes a segmentation fault on exit on Arch Linux
 
+    stopResidentWorker();
+    delete m_compileCache;
+    delete m_gnuplotCache;
     delete m_tikzPdfDoc;
 }
 
+TikzPreviewGenerator::Settings::Settings()
+    : dvisvgmCommand(QLatin1String("dvisvgm")),
+      previewEngine(PdfEngine),
+      useShellEscaping(false), // is set in setShellEscaping() at startup
+      usePreambleFormat(true),
+      useResidentWorker(false),
+      useIncrementalCompilation(false),
+      useCompileCache(true),
+      compileCacheSize(100 * 1024 * 1024),
+      abortOnFirstError(false),
+      useDraftPreCheck(false),
+      cpuTimeLimit(0),
+      memoryLimit(0),
+      timeLimit(0),
+      processEnvironment(QProcessEnvironment::systemEnvironment())
+{
+}
+
+/***************************************************************************/
+
+/*!
+ * Returns the settings which apply to the current run.  In m_thread these
+ * are the settings taken at the start of the job which is being handled, so
+ * that a job is not affected by changes made while it is running; in the
+ * other threads (e.g. when exporting) these are the latest settings.
+ */
+
+std::shared_ptr<const TikzPreviewGenerator::Settings> TikzPreviewGenerator::settings() const
+{
+    if (QThread::currentThread() == &m_thread && m_jobSettings)
+        return m_jobSettings;
+    return std::atomic_load(&m_settings);
+}
+
+/*!
+ * Returns a modifiable copy of the latest settings, which is published
+ * with publishSettings() after it has been changed.  The setters are only
+ * called in the main thread, so no change can be lost between both calls.
+ */
+
+std::shared_ptr<TikzPreviewGenerator::Settings> TikzPreviewGenerator::copySettings() const
+{
+    return std::make_shared<Settings>(*std::atomic_load(&m_settings));
+}
+
+void TikzPreviewGenerator::publishSettings(const std::shared_ptr<const Settings> &settings)
+{
+    std::atomic_store(&m_settings, settings);
+}
+
 /***************************************************************************/
 
+/*!
+ * Sets the TikZ code which is compiled by a generator without a controller
+ * (e.g. when rendering files from the command line); otherwise the code is
+ * taken from the controller.
+ */
+
+void TikzPreviewGenerator::setTikzCode(const QString &tikzCode)
+{
+    const QMutexLocker lock(&m_memberLock);
+    m_sourceTikzCode = tikzCode;
+}
+
+const TextCodecProfile *TikzPreviewGenerator::textCodecProfile() const
+{
+    static const TextCodecProfile defaultTextCodecProfile;
+    return m_parent ? m_parent->textCodecProfile() : &defaultTextCodecProfile;
+}
+
 void TikzPreviewGenerator::setTikzFileBaseName(const QString &name)
 {
     const QMutexLocker lock(&m_memberLock);
+    if (name != m_tikzFileBaseName) {
+        // nothing has been written in the new directory yet
+        m_writtenLatexCode.clear();
+        m_previousTikzUnitNames.clear();
+    }
     m_tikzFileBaseName = name;
 }
 
 void TikzPreviewGenerator::setLatexCommand(const QString &command)
 {
-    const QMutexLocker lock(&m_memberLock);
-    m_latexCommand = command;
+    const std::shared_ptr<Settings> settings = copySettings();
+    settings->latexCommand = command;
+    publishSettings(settings);
 }
 
 void TikzPreviewGenerator::setPdftopsCommand(const QString &command)
 {
-    const QMutexLocker lock(&m_memberLock);
-    m_pdftopsCommand = command;
+    const std::shared_ptr<Settings> settings = copySettings();
+    settings->pdftopsCommand = command;
+    publishSettings(settings);
+}
+
+void TikzPreviewGenerator::setDvisvgmCommand(const QString &command)
+{
+    const std::shared_ptr<Settings> settings = copySettings();
+    settings->dvisvgmCommand = command;
+    publishSettings(settings);
+}
+
+/*!
+ * Sets whether the preview is first shown from a DVI file that is converted
+ * to SVG (which is faster than generating a PDF file for simple pictures)
+ * before the PDF file, which is used for exporting, is generated.  The fast
+ * preview is only possible if \c pdflatex or \c lualatex is used.
+ */
+
+void TikzPreviewGenerator::setPreviewEngine(PreviewEngine engine)
+{
+    const std::shared_ptr<Settings> settings = copySettings();
+    settings->previewEngine = engine;
+    publishSettings(settings);
 }
 
 void TikzPreviewGenerator::setShellEscaping(bool useShellEscaping)
 {
-    m_memberLock.lock();
-    m_useShellEscaping = useShellEscaping;
-    m_memberLock.unlock();
+    const std::shared_ptr<Settings> settings = copySettings();
+    settings->useShellEscaping = useShellEscaping;
+    publishSettings(settings);
 
     if (useShellEscaping) {
         QString gnuplotPath =
@@ -112,12 +243,110 @@ void TikzPreviewGenerator::setShellEscaping(bool useShellEscaping)
     }
 }
 
+void TikzPreviewGenerator::setUsePreambleFormat(bool usePreambleFormat)
+{
+    const std::shared_ptr<Settings> settings = copySettings();
+    settings->usePreambleFormat = usePreambleFormat;
+    publishSettings(settings);
+}
+
+void TikzPreviewGenerator::setUseResidentWorker(bool useResidentWorker)
+{
+    const std::shared_ptr<Settings> settings = copySettings();
+    settings->useResidentWorker = useResidentWorker;
+    publishSettings(settings);
+}
+
+void TikzPreviewGenerator::setUseIncrementalCompilation(bool useIncrementalCompilation)
+{
+    const std::shared_ptr<Settings> settings = copySettings();
+    settings->useIncrementalCompilation = useIncrementalCompilation;
+    publishSettings(settings);
+}
+
+void TikzPreviewGenerator::setUseCompileCache(bool useCompileCache)
+{
+    const std::shared_ptr<Settings> settings = copySettings();
+    settings->useCompileCache = useCompileCache;
+    publishSettings(settings);
+}
+
+void TikzPreviewGenerator::setCompileCacheSize(qint64 size)
+{
+    const std::shared_ptr<Settings> settings = copySettings();
+    settings->compileCacheSize = size;
+    publishSettings(settings);
+}
+
+void TikzPreviewGenerator::setAbortOnFirstError(bool abortOnFirstError)
+{
+    const std::shared_ptr<Settings> settings = copySettings();
+    settings->abortOnFirstError = abortOnFirstError;
+    publishSettings(settings);
+}
+
+/*!
+ * Sets whether the TikZ code is first compiled in draft mode (without
+ * writing a PDF file), so that errors are found sooner while typing and the
+ * PDF file is only generated for code that compiles.
+ */
+
+void TikzPreviewGenerator::setUseDraftPreCheck(bool useDraftPreCheck)
+{
+    const std::shared_ptr<Settings> settings = copySettings();
+    settings->useDraftPreCheck = useDraftPreCheck;
+    publishSettings(settings);
+}
+
+/*!
+ * Limits the CPU time (in seconds), the memory (in MiB) and the wall-clock
+ * time (in seconds) of each process run to generate the preview; a value of
+ * 0 means no limit.  The limits also apply to the programs started by LaTeX
+ * (e.g. gnuplot).
+ */
+
+void TikzPreviewGenerator::setResourceLimits(int cpuTimeLimit, int memoryLimit, int timeLimit)
+{
+    const std::shared_ptr<Settings> settings = copySettings();
+    settings->cpuTimeLimit = cpuTimeLimit;
+    settings->memoryLimit = memoryLimit;
+    settings->timeLimit = timeLimit;
+    publishSettings(settings);
+}
+
+/*!
+ * Sets whether the window of this generator has the focus.  Its LaTeX runs
+ * are then scheduled before those of the other windows and are run with
+ * normal priority instead of a lower one.
+ */
+
+void TikzPreviewGenerator::setForeground(bool isForeground)
+{
+    m_isForeground.storeRelease(isForeground);
+}
+
+void TikzPreviewGenerator::setCompileTimeEstimate(qreal compileTimeEstimate)
+{
+    m_compileTimeEstimate.store(compileTimeEstimate);
+}
+
+/*!
+ * Sets the fraction of the estimated compile time after which a run is
+ * allowed to finish when a new preview is requested.  If \p finishFraction
+ * is negative, the run is always aborted.
+ */
+
+void TikzPreviewGenerator::setFinishFraction(qreal finishFraction)
+{
+    m_finishFraction.store(finishFraction);
+}
+
 void TikzPreviewGenerator::setTemplateFile(const QString &fileName)
 {
-    m_memberLock.lock();
-    const QString oldTemplateFileName = m_templateFileName;
-    m_templateFileName = fileName;
-    m_memberLock.unlock();
+    const std::shared_ptr<Settings> settings = copySettings();
+    const QString oldTemplateFileName = settings->templateFileName;
+    settings->templateFileName = fileName;
+    publishSettings(settings);
 
     if (!oldTemplateFileName.isEmpty())
         removeFromLatexSearchPath(QFileInfo(oldTemplateFileName).absolutePath());
@@ -128,8 +357,9 @@ void TikzPreviewGenerator::setTemplateFile(const QString &fileName)
 
 void TikzPreviewGenerator::setReplaceText(const QString &replace)
 {
-    const QMutexLocker lock(&m_memberLock);
-    m_tikzReplaceText = replace;
+    const std::shared_ptr<Settings> settings = copySettings();
+    settings->tikzReplaceText = replace;
+    publishSettings(settings);
 }
 
 /***************************************************************************/
@@ -140,177 +370,347 @@ QString TikzPreviewGenerator::getLogText() const
     return m_logText;
 }
 
-static QString getParsedLogText(QTextStream *logStream)
+static QString getParsedLogText(const QString &log)
 {
     QString logText;
 
-    QRegExp errorPattern(QLatin1String("(\\S*):(\\d+): (.*$)"));
-    QList<QLatin1String> errorMessageList;
-    errorMessageList << QLatin1String("Undefined control sequence")
-                     << QLatin1String("LaTeX Warning:") << QLatin1String("LaTeX Error:")
-                     << QLatin1String("Runaway argument?") << QLatin1String("Missing character:")
-                     << QLatin1String("Error:");
-
-    QString logLine;
-    while (!logStream->atEnd()) {
-        logLine = logStream->readLine();
-        if (errorPattern.indexIn(logLine) > -1) {
+    const QVector<QStringRef> logLines = log.splitRef(QLatin1Char('\n'));
+    const int lastLine = logLines.size() - 1;
+    int i = 0; // the first line which has not been added to logText yet
+    const QVector<TikzLogScanner::Diagnostic> diagnostics = TikzLogScanner::scan(log);
+    for (const auto &diagnostic : diagnostics) {
+        if (diagnostic.logLine < i) // already added as part of the previous message
+            continue;
+        i = diagnostic.logLine;
+        if (diagnostic.kind == TikzLogScanner::FileLineError) {
             // show error message and correct line number
-            QString lineNum = QString::number(errorPattern.cap(2).toInt());
-            const QString errorMsg = errorPattern.cap(3);
-            logText += QLatin1String("[LaTeX] Line ") + lineNum + QLatin1String(": ") + errorMsg;
+            QString lineNum = QString::number(diagnostic.sourceLine);
+            logText += QLatin1String("[LaTeX] Line ") + lineNum + QLatin1String(": ")
+                    + log.midRef(diagnostic.messageOffset, diagnostic.messageLength);
 
             // while we don't get a line starting with "l.<number> ...", we have to add the line to
             // the first error message
-            QRegExp rx(QLatin1String("^l\\.(\\d+)(.*)"));
-            logLine = logStream->readLine();
-            while (rx.indexIn(logLine) < 0 && !logStream->atEnd()) {
-                if (logLine.isEmpty())
+            int sourceLine = 0;
+            int restOffset = 0;
+            ++i;
+            while (i < lastLine
+                   && !TikzLogScanner::isLineReference(logLines.at(i), &sourceLine, &restOffset)) {
+                if (logLines.at(i).isEmpty())
                     logText += QLatin1String("\n[LaTeX] Line ") + lineNum + QLatin1String(": ");
-                if (!logLine.startsWith(
+                if (!logLines.at(i).startsWith(
                             QLatin1String("Type"))) // don't add lines that invite the user to type
                                                     // a command, since we are not in the console
-                    logText += logLine;
-                logLine = logStream->readLine();
+                    logText += logLines.at(i);
+                ++i;
             }
             logText += QLatin1Char('\n');
-            if (logStream->atEnd())
+            if (i >= lastLine)
                 break;
 
             // add the line starting with "l.<number> ..." and the next line
-            lineNum = QString::number(rx.cap(1).toInt() - 7);
-            logLine = QLatin1String("l.") + lineNum + rx.cap(2);
-            logText += logLine + QLatin1Char('\n');
-            logText += logStream->readLine() + QLatin1Char('\n');
-        } else {
-            for (int i = 1; i < errorMessageList.size(); ++i) {
-                if (logLine.contains(errorMessageList.at(i))) {
-                    logText += logLine + QLatin1Char('\n');
-                    logText += logStream->readLine() + QLatin1Char('\n');
-                    logText += logStream->readLine()
-                            + QLatin1Char(
-                                       '\n'); // we assume that the error message is not displayed
-                                              // on more than 3 lines in the log, so we stop here
-                    break;
-                }
-            }
+            lineNum = QString::number(sourceLine - 7);
+            logText += QLatin1String("l.") + lineNum + logLines.at(i).mid(restOffset)
+                    + QLatin1Char('\n');
+            ++i;
+            logText += logLines.at(i) + QLatin1Char('\n');
+            ++i;
+        } else if (diagnostic.kind == TikzLogScanner::KnownMessage) {
+            // we assume that the error message is not displayed on more than
+            // 3 lines in the log, so we stop here
+            for (int j = i; j < i + 3; ++j)
+                logText += (j <= lastLine ? logLines.at(j).toString() : QString())
+                        + QLatin1Char('\n');
+            i += 3;
         }
     }
 
     return logText;
 }
 
-void TikzPreviewGenerator::parseLogFile()
+void TikzPreviewGenerator::parseLogFile(const QString &tikzFileBaseName)
 {
-    const QMutexLocker lock(&m_memberLock);
+    // the log file is read and parsed without holding the lock
     QString longLogText;
     const QString latexLogFilePath =
-            QFileInfo(m_tikzFileBaseName + QLatin1String(".log")).absoluteFilePath();
+            QFileInfo(tikzFileBaseName + QLatin1String(".log")).absoluteFilePath();
     QFile latexLogFile(latexLogFilePath);
-    if (!latexLogFile.open(QFile::ReadOnly | QIODevice::Text)) {
+    const bool opened = latexLogFile.open(QFile::ReadOnly | QIODevice::Text);
+    QString logText;
+    if (opened) {
+        QTextStream latexLog(&latexLogFile);
+        logText = latexLog.readAll();
+        latexLogFile.close();
+    }
+
+    // when LaTeX has been stopped at the first error, the log file is
+    // incomplete and the error has already been taken from the output
+    m_memberLock.lock();
+    const bool showParsedLog = opened && m_runFailed.loadAcquire() && !m_stoppedAtFirstError
+            && !m_limitExceeded && !m_shortLogText.contains(tr("Process aborted."));
+    m_memberLock.unlock();
+    if (showParsedLog)
+        longLogText = getParsedLogText(logText);
+
+    const QMutexLocker lock(&m_memberLock);
+    if (!opened) {
         if (!m_tikzCode.isEmpty()) {
             longLogText = QLatin1String("\n[LaTeX] ")
                     + tr("Warning: could not load LaTeX log file.", "info process");
             m_shortLogText += longLogText;
             longLogText += tr("\nLog file: %1", "info process").arg(latexLogFilePath);
             Q_EMIT showErrorMessage(m_shortLogText);
-            Q_EMIT appendLog(longLogText, m_runFailed);
+            Q_EMIT appendLog(longLogText, m_runFailed.loadAcquire());
         } else {
             qCritical("does that ever happen?");
             m_shortLogText.clear();
             m_logText.clear();
-            Q_EMIT updateLog(QString(), m_runFailed);
+            Q_EMIT updateLog(QString(), m_runFailed.loadAcquire());
         }
     } else {
-        QTextStream latexLog(&latexLogFile);
-        if (m_runFailed && !m_shortLogText.contains(tr("Process aborted."))) {
-            longLogText = getParsedLogText(&latexLog);
-            Q_EMIT updateLog(longLogText, m_runFailed);
-        }
-        latexLog.seek(0);
-        m_logText += latexLog.readAll();
-        latexLogFile.close();
+        if (showParsedLog)
+            Q_EMIT updateLog(longLogText, m_runFailed.loadAcquire());
+        m_logText += logText;
     }
 }
 
 /***************************************************************************/
 
-static QList<qreal> tikzCoordinates(const QString &tikzFileBaseName)
-{
-    QList<qreal> tikzCoordinateList;
-    const QFileInfo tikzAuxFileInfo = QFileInfo(tikzFileBaseName + QLatin1String(".ktikzaux"));
-    QFile tikzAuxFile(tikzAuxFileInfo.absoluteFilePath());
-    if (tikzAuxFile.open(QFile::ReadOnly | QIODevice::Text)) {
-        QTextStream tikzAuxFileStream(&tikzAuxFile);
-        while (!tikzAuxFileStream.atEnd()) {
-            QStringList tikzCoordinateStringList =
-                    tikzAuxFileStream.readLine().split(QLatin1Char(';'));
-            for (const auto &tikzCoordinateString : tikzCoordinateStringList) {
-                tikzCoordinateList << tikzCoordinateString.toDouble();
-            }
-        }
-    }
-    return tikzCoordinateList;
-}
-
-static QString createTempLatexFile(const QString &tikzFileBaseName, const QString &templateFileName,
-                                   const QString &tikzReplaceText,
+static QString createLatexCode(const QString &templateFileName, const QString &tikzReplaceText,
+                               const TextCodecProfile *codecProfile);
+static QStringList splitTikzPictures(const QString &tikzCode);
+static QString createTempLatexFile(const QString &tikzFileBaseName, const QString &latexCode,
                                    const TextCodecProfile *codecProfile);
 static QString createTempTikzFile(const QString &tikzFileBaseName, const QString &tikzCode,
                                   const TextCodecProfile *codecProfile);
+static QString dviLatexCommand(const QString &latexCommand);
+
+/*!
+ * Compiles the TikZ code and loads the resulting PDF file.  Returns true if
+ * the preview has been updated.
+ */
 
-void TikzPreviewGenerator::createPreview()
+bool TikzPreviewGenerator::createPreview()
 {
     // avoid that the user can export to a file while the preview is being generated
     Q_EMIT setExportActionsEnabled(false);
 
-    // avoid that the previous picture is still displayed
+    // the settings are taken once at the start of the job, so they do not
+    // change while it is running
+    const std::shared_ptr<const Settings> settings = m_jobSettings;
+    const QString latexCommand = settings->latexCommand;
+    const bool useShellEscaping = settings->useShellEscaping;
+
+    // avoid that the previous picture is still displayed; the members are
+    // copied under the lock, which is released before any file is written,
+    // so that the main thread never waits for the disk
     m_memberLock.lock();
     if (m_tikzCode.isEmpty()) {
         m_memberLock.unlock();
-        return;
+        return false;
     }
+    const QString tikzCode = m_tikzCode;
+    const QString tikzFileBaseName = m_tikzFileBaseName;
+    const bool templateChanged = m_templateChanged;
+    m_templateChanged = false;
+    m_memberLock.unlock();
 
     // load template file if changed
-    if (m_templateChanged) {
-        const QString errorString =
-                createTempLatexFile(m_tikzFileBaseName, m_templateFileName, m_tikzReplaceText,
-                                    m_parent->textCodecProfile());
-        if (!errorString.isEmpty()) {
-            showFileWriteError(m_tikzFileBaseName + QLatin1String(".tex"), errorString);
-            m_memberLock.unlock();
-            return;
-        }
-        m_templateChanged = false;
+    if (templateChanged && reloadTemplate()) {
+        stopResidentWorker(); // it has opened the files which are removed now
+        removeTemplateDependentFiles();
+    }
+    m_memberLock.lock();
+    const QString templateCode = m_latexCode;
+    const QStringList dependencies = m_dependencies;
+    m_memberLock.unlock();
+
+    // the fast preview compiles the full template to DVI, so it does not use
+    // the preamble format, the separately compiled pictures or the cache
+    const bool fastPreview = settings->previewEngine == FastPreviewEngine
+            && !dviLatexCommand(latexCommand).isEmpty();
+
+    // if the preamble of the template has already been dumped in a format,
+    // then only the body of the template must be compiled, otherwise the
+    // format is built in the background for the next runs
+    QString formatFile;
+    QString latexCode = templateCode;
+    QString preamble;
+    QString body;
+    if (!fastPreview && settings->usePreambleFormat
+        && TikzFormatCache::isSupportedCommand(latexCommand)
+        && TikzFormatCache::splitLatexCode(templateCode, &preamble, &body)) {
+        formatFile =
+                m_formatCache->formatFile(preamble, latexCommand, settings->processEnvironment);
+        if (formatFile.isEmpty())
+            m_formatCache->buildFormat(preamble, latexCommand, settings->processEnvironment);
+        else
+            latexCode = body;
     }
+    if (!writeLatexFile(latexCode))
+        return false;
 
     // load tikz code
     const QString errorString =
-            createTempTikzFile(m_tikzFileBaseName, m_tikzCode, m_parent->textCodecProfile());
+            createTempTikzFile(tikzFileBaseName, tikzCode, textCodecProfile());
     if (!errorString.isEmpty()) {
-        showFileWriteError(m_tikzFileBaseName + QLatin1String(".pgf"), errorString);
-        m_memberLock.unlock();
-        return;
+        showFileWriteError(tikzFileBaseName + QLatin1String(".pgf"), errorString);
+        return false;
+    }
+
+    // the code may have been edited again while the files were written
+    if (isCancelled())
+        return false;
+
+    // with more than one tikzpicture, each picture may be compiled separately
+    // if the template puts each picture on its own page (the pages are put
+    // together with pdfTeX, so this requires pdflatex)
+    const QStringList tikzPictureCodes = !fastPreview && settings->useIncrementalCompilation
+                    && QFileInfo(latexCommand).completeBaseName() == QLatin1String("pdflatex")
+                    && templateCode.contains(QLatin1String("\\PreviewEnvironment"))
+            ? splitTikzPictures(tikzCode)
+            : QStringList();
+
+    // exactly the same code may have been compiled before (e.g. before an
+    // undo); the files which it reads are assumed to be those read by the
+    // previous run, a result stored with other files is then not found
+    QString cacheKey = settings->useCompileCache && !fastPreview
+            ? TikzCompileCache::key(templateCode, tikzCode, latexCommand, useShellEscaping,
+                                    settings->processEnvironment, dependencies)
+            : QString();
+    bool restored = false;
+    if (!cacheKey.isEmpty() && m_compileCache->find(cacheKey)) {
+        stopResidentWorker(); // it has opened the log and auxiliary files which are replaced
+        restored = m_compileCache->restore(cacheKey, tikzFileBaseName);
     }
 
+    // the tables which gnuplot has computed for the same plots before are
+    // put back in the temporary directory (which is new in each session),
+    // so that PGF does not run gnuplot again
+    const QString workingDir = QFileInfo(tikzFileBaseName).absolutePath();
+    const QString gnuplotKey = useShellEscaping && !restored
+            ? TikzGnuplotCache::key(templateCode, tikzCode)
+            : QString();
+    if (!gnuplotKey.isEmpty())
+        m_gnuplotCache->restore(gnuplotKey, workingDir);
+
     // compile everything, show preview and parse log
+    m_memberLock.lock();
     m_logText.clear();
     m_memberLock.unlock();
-    if (generatePdfFile(m_tikzFileBaseName, m_latexCommand, m_useShellEscaping)) {
+    m_compileStartTime.store(m_clock.elapsed());
+    QString logFileBaseName = tikzFileBaseName;
+    bool success = true;
+    if (restored)
+        Q_EMIT updateLog(QLatin1String("[LaTeX] ")
+                                 + tr("The preview has been restored from the cache.",
+                                      "info process"),
+                         false);
+    else if (!tikzPictureCodes.isEmpty())
+        success = generateIncrementalPdfFile(tikzPictureCodes, formatFile, &logFileBaseName);
+    else if (fastPreview) {
+        // the SVG pages are shown as soon as they are ready, the PDF file
+        // is generated afterwards (it is aborted when the code is edited),
+        // also when the DVI run fails since the code may only fail with the
+        // dvisvgm driver
+        const bool svgSuccess =
+                generateSvgFiles(tikzFileBaseName, latexCommand, useShellEscaping);
+        success = !isCancelled();
+        if (success) {
+            const qint64 svgTime = compileTime();
+            success = generatePdfFile(tikzFileBaseName, latexCommand, useShellEscaping);
+            if (svgSuccess)
+                qDebug() << "fast preview shown after" << svgTime
+                         << "ms, PDF file generated after" << compileTime() << "ms";
+            else
+                qDebug() << "DVI run failed, PDF file generated after" << compileTime()
+                         << "ms";
+        }
+    } else {
+        qint64 draftTime;
+        success = runDraftPreCheck(tikzFileBaseName, latexCommand, useShellEscaping,
+                                   formatFile, &draftTime)
+                && !isCancelled();
+        if (success) {
+            QElapsedTimer pdfTimer;
+            pdfTimer.start();
+            success = generatePdfFile(tikzFileBaseName, latexCommand, useShellEscaping,
+                                      formatFile);
+            if (draftTime >= 0)
+                qDebug() << "draft mode check:" << draftTime << "ms, PDF run:"
+                         << pdfTimer.elapsed() << "ms";
+        } else if (draftTime >= 0)
+            qDebug() << "draft mode check:" << draftTime << "ms, PDF run skipped";
+    }
+    if (!success && !formatFile.isEmpty() && !isCancelled()
+        && !QFileInfo::exists(logFileBaseName + QLatin1String(".log"))) {
+        // LaTeX did not even get to write a log file, so the format could
+        // not be loaded (e.g. because the TeX installation has been updated
+        // since the format was dumped); compile the full template instead
+        m_formatCache->removeFormat(formatFile);
+        formatFile.clear();
+        if (writeLatexFile(templateCode))
+            success = !tikzPictureCodes.isEmpty()
+                    ? generateIncrementalPdfFile(tikzPictureCodes, formatFile, &logFileBaseName)
+                    : generatePdfFile(tikzFileBaseName, latexCommand, useShellEscaping);
+    }
+    const qint64 elapsedTime = compileTime();
+    m_compileStartTime.store(-1);
+    if (!restored && !isCancelled())
+        Q_EMIT compilationFinished(elapsedTime);
+
+    // the files read by LaTeX are only known now, the result is stored
+    // under a key which takes them into account
+    if (success && !gnuplotKey.isEmpty())
+        m_gnuplotCache->store(gnuplotKey, workingDir,
+                              recorderFileNames(!tikzPictureCodes.isEmpty()));
+    if (!restored && updateDependencies(!tikzPictureCodes.isEmpty()) && !cacheKey.isEmpty()) {
         m_memberLock.lock();
-        const QFileInfo tikzPdfFileInfo(m_tikzFileBaseName + QLatin1String(".pdf"));
-        if (!tikzPdfFileInfo.exists())
+        const QStringList newDependencies = m_dependencies;
+        m_memberLock.unlock();
+        cacheKey = TikzCompileCache::key(templateCode, tikzCode, latexCommand, useShellEscaping,
+                                         settings->processEnvironment, newDependencies);
+    }
+    bool loaded = false;
+    if (success && !isCancelled()) {
+        // the PDF file is read only once and Poppler parses it from memory;
+        // this is done without holding the lock, so that aborting is not
+        // delayed, and the result is dropped when the request is cancelled
+        const QFileInfo tikzPdfFileInfo(tikzFileBaseName + QLatin1String(".pdf"));
+        QFile tikzPdfFile(tikzPdfFileInfo.absoluteFilePath());
+        QByteArray tikzPdfData;
+        Poppler::Document *tikzPdfDoc = 0;
+        QVector<TikzPictureMetrics> tikzPictureMetrics;
+        const bool opened = tikzPdfFile.open(QIODevice::ReadOnly);
+        if (!opened)
             qWarning() << "Error:" << qPrintable(tikzPdfFileInfo.absoluteFilePath())
                        << "does not exist";
+        else {
+            tikzPdfData = tikzPdfFile.readAll();
+            tikzPdfFile.close();
+            if (!isCancelled())
+                tikzPdfDoc = Poppler::Document::loadFromData(tikzPdfData);
+            // the metrics are parsed once and always passed together with
+            // the PDF document to which they belong
+            if (tikzPdfDoc && !isCancelled())
+                tikzPictureMetrics = TikzPictureMetrics::read(
+                        tikzFileBaseName + QLatin1String(".ktikzaux"), tikzCode);
+        }
+
+        m_memberLock.lock();
+        if (!opened || isCancelled())
+            delete tikzPdfDoc;
         else {
             // Update widget
             if (m_tikzPdfDoc)
                 delete m_tikzPdfDoc;
-            m_tikzPdfDoc = Poppler::Document::load(tikzPdfFileInfo.absoluteFilePath());
+            m_tikzPdfData = tikzPdfData;
+            m_tikzPdfDoc = tikzPdfDoc;
+            loaded = m_tikzPdfDoc != 0;
             if (m_tikzPdfDoc) {
                 m_shortLogText = QLatin1String("[LaTeX] ")
                         + tr("Process finished successfully.", "info process");
-                Q_EMIT pixmapUpdated(m_tikzPdfDoc, tikzCoordinates(m_tikzFileBaseName));
+                m_tikzPictureMetrics = tikzPictureMetrics;
+                Q_EMIT pixmapUpdated(m_tikzPdfDoc, m_tikzPictureMetrics);
                 Q_EMIT setExportActionsEnabled(true);
             } else {
                 m_shortLogText = QLatin1String("[LaTeX] ")
@@ -320,55 +720,259 @@ void TikzPreviewGenerator::createPreview()
                 Q_EMIT updateLog(
                         m_shortLogText
                                 + tr("\nPDF file: %1").arg(tikzPdfFileInfo.absoluteFilePath()),
-                        m_runFailed);
+                        m_runFailed.loadAcquire());
             }
         }
         m_memberLock.unlock();
+
+        // the files are copied into the cache after the lock has been released
+        if (loaded && !cacheKey.isEmpty() && !restored)
+            m_compileCache->store(cacheKey, tikzFileBaseName, logFileBaseName);
     }
-    parseLogFile();
+    // the log of a superseded run is not shown
+    if (!isCancelled())
+        parseLogFile(logFileBaseName);
+
+    // the worker is only started now, because it immediately starts writing
+    // the log and auxiliary files which we have just read
+    if (settings->useResidentWorker && !formatFile.isEmpty() && tikzPictureCodes.isEmpty())
+        startResidentWorker(tikzFileBaseName, latexCommand, useShellEscaping, formatFile);
+    else
+        stopResidentWorker();
+    return loaded;
 }
 
 /***************************************************************************/
 
-bool TikzPreviewGenerator::hasRunFailed()
+/*!
+ * Returns true if the last run has failed.  This function does not lock
+ * m_memberLock, so it does not wait for the generator while it is busy.
+ */
+
+bool TikzPreviewGenerator::hasRunFailed() const
 {
-    const QMutexLocker lock(&m_memberLock);
-    return m_runFailed;
+    return m_runFailed.loadAcquire();
 }
 
 void TikzPreviewGenerator::generatePreview(TemplateStatus templateStatus)
 {
+    const int request = m_latestRequest.fetchAndAddOrdered(1) + 1;
+    if (templateStatus == ReloadTemplate)
+        m_reloadRequested.storeRelease(1);
+
     // Dirty hack because calling generatePreviewImpl directly from the main
     // thread runs it in the main thread (only when triggered by a signal,
     // it is run in the new thread).
-    // Note that abortProcess() must be run in the main thread; it kills
+    // Note that cancelRequests() must be run in the main thread; it stops
     // previous calls to generatePreviewImpl() so that there is no
-    // interference between consecutive calls.
-    abortProcess();
-    QMetaObject::invokeMethod(this, "generatePreviewImpl", Q_ARG(TemplateStatus, templateStatus));
+    // interference between consecutive calls.  A run which is nearly
+    // finished is not killed (unless the template has changed), the new
+    // request is then handled after it.
+    if (templateStatus == ReloadTemplate || !isNearlyFinished())
+        cancelRequests(request - 1);
+    QMetaObject::invokeMethod(this, "generatePreviewImpl", Q_ARG(int, request));
+}
+
+/*!
+ * Returns true if the TikZ code is being compiled and, according to the
+ * compile time of the previous runs, the run is far enough to be allowed
+ * to finish.  A run which takes more than twice as long as expected may
+ * hang, so it is not considered to be nearly finished.
+ */
+
+bool TikzPreviewGenerator::isNearlyFinished() const
+{
+    const qreal finishFraction = m_finishFraction.load();
+    const qreal compileTimeEstimate = m_compileTimeEstimate.load();
+    const qint64 elapsedTime = compileTime();
+    if (finishFraction < 0 || compileTimeEstimate <= 0 || elapsedTime < 0)
+        return false;
+    return elapsedTime >= finishFraction * compileTimeEstimate
+            && elapsedTime < 2 * compileTimeEstimate;
 }
 
-void TikzPreviewGenerator::generatePreviewImpl(TemplateStatus templateStatus)
+/*!
+ * Returns the time in msec since the compilation of the TikZ code has
+ * started, or -1 if it is not being compiled.  Like isNearlyFinished(),
+ * this function does not lock m_memberLock.
+ */
+
+qint64 TikzPreviewGenerator::compileTime() const
 {
-    m_memberLock.lock();
-    // Each time the tikz code is edited TikzPreviewController->regeneratePreview()
-    // is run, which runs generatePreview(DontReloadTemplate). This is OK
-    // in all cases, except at startup, because then the template is not yet
-    // copied to the temporary directory, so in order to make this happen,
-    // m_templateChanged should be set to true.
-    if (m_firstRun) {
-        m_templateChanged = true;
-        m_firstRun = false;
-    } else
-        m_templateChanged = (templateStatus == ReloadTemplate);
-    m_tikzCode = m_parent->tikzCode();
-    m_runFailed = false;
-    m_memberLock.unlock();
-    createPreview();
+    const qint64 startTime = m_compileStartTime.load();
+    return startTime < 0 ? -1 : m_clock.elapsed() - startTime;
+}
+
+void TikzPreviewGenerator::generatePreviewImpl(int request)
+{
+    // a newer request has been queued after this one
+    if (request != m_latestRequest.loadAcquire()) {
+        m_coalescedJobCount.ref();
+        return;
+    }
+
+    // runProcess() waits for the process in an event loop, in which the next
+    // request may be delivered; that request is handled as soon as the
+    // current one has returned
+    if (m_generating) {
+        m_hasPendingRequest = true;
+        return;
+    }
+
+    m_generating = true;
+    for (;;) {
+        const TemplateStatus templateStatus =
+                m_reloadRequested.fetchAndStoreOrdered(0) ? ReloadTemplate : DontReloadTemplate;
+        m_memberLock.lock();
+        // Each time the tikz code is edited TikzPreviewController->regeneratePreview()
+        // is run, which runs generatePreview(DontReloadTemplate). This is OK
+        // in all cases, except at startup, because then the template is not yet
+        // copied to the temporary directory, so in order to make this happen,
+        // m_templateChanged should be set to true.
+        if (m_firstRun) {
+            m_templateChanged = true;
+            m_firstRun = false;
+        } else
+            m_templateChanged = m_templateChanged || (templateStatus == ReloadTemplate);
+        m_tikzCode = m_parent ? m_parent->tikzCode() : m_sourceTikzCode;
+        m_runFailed.storeRelease(0);
+        m_memberLock.unlock();
+        // every stage of createPreview() checks whether the request which is
+        // being handled has been cancelled in the meantime
+        m_generation.storeRelease(m_latestRequest.loadAcquire());
+        m_jobSettings = std::atomic_load(&m_settings);
+        m_compileCache->setMaximumSize(m_jobSettings->compileCacheSize);
+        m_gnuplotCache->setMaximumSize(m_jobSettings->compileCacheSize);
+        const bool success = createPreview();
+        if (isCancelled())
+            m_abortedJobCount.ref();
+        else
+            m_completedJobCount.ref();
+        Q_EMIT previewFinished(success);
+
+        if (!m_hasPendingRequest)
+            break;
+        m_hasPendingRequest = false;
+    }
+    m_generating = false;
+}
+
+/*!
+ * Returns the number of preview jobs which have been completed since this
+ * generator has been created.  This function is thread-safe, as are
+ * abortedJobCount() and coalescedJobCount().
+ */
+
+int TikzPreviewGenerator::completedJobCount() const
+{
+    return m_completedJobCount.loadAcquire();
+}
+
+/*!
+ * Returns the number of preview jobs which have been cancelled while they
+ * were running because the TikZ code has been edited again.
+ */
+
+int TikzPreviewGenerator::abortedJobCount() const
+{
+    return m_abortedJobCount.loadAcquire();
+}
+
+/*!
+ * Returns the number of preview requests which have been dropped before
+ * they were started, because a newer request had already been queued.
+ */
+
+int TikzPreviewGenerator::coalescedJobCount() const
+{
+    return m_coalescedJobCount.loadAcquire();
 }
 
 /***************************************************************************/
 
+/*!
+ * Returns the name of the codec with which \p codecProfile reads files.
+ */
+
+static QByteArray decodingCodecName(const TextCodecProfile *codecProfile)
+{
+    QTextStream textStream;
+    codecProfile->configureStreamDecoding(textStream);
+    return textStream.codec() ? textStream.codec()->name() : QByteArray();
+}
+
+/*!
+ * Reads the template again if the template file, the replace text or the
+ * codec have changed since the template was last read.  Returns true if this
+ * results in other LaTeX code, so that a reload of an unchanged template
+ * costs no more than a stat() of the template file.  The template is read
+ * without holding m_memberLock.
+ */
+
+bool TikzPreviewGenerator::reloadTemplate()
+{
+    QElapsedTimer reloadTimer;
+    reloadTimer.start();
+    const QString templateFileName = m_jobSettings->templateFileName;
+    const QString tikzReplaceText = m_jobSettings->tikzReplaceText;
+    const QFileInfo templateFileInfo(templateFileName);
+    const QByteArray templateStamp =
+            (templateFileName + QLatin1Char('\n') + tikzReplaceText + QLatin1Char('\n')
+             + QString::number(templateFileInfo.size()) + QLatin1Char('\n')
+             + QString::number(templateFileInfo.lastModified().toMSecsSinceEpoch()))
+                    .toUtf8()
+            + '\n' + decodingCodecName(textCodecProfile());
+    if (templateStamp == m_templateStamp) {
+        qDebug() << "template unchanged, checked in" << reloadTimer.nsecsElapsed() / 1000 << "us";
+        return false;
+    }
+    m_templateStamp = templateStamp;
+
+    // the file may have been saved without changes
+    const QString latexCode =
+            createLatexCode(templateFileName, tikzReplaceText, textCodecProfile());
+    const QByteArray latexCodeHash =
+            QCryptographicHash::hash(latexCode.toUtf8(), QCryptographicHash::Sha1);
+    const bool changed = latexCodeHash != m_latexCodeHash;
+    if (changed) {
+        const QMutexLocker lock(&m_memberLock);
+        m_latexCode = latexCode;
+        m_latexCodeHash = latexCodeHash;
+    }
+    qDebug() << "template" << (changed ? "changed," : "unchanged,") << "read in"
+             << reloadTimer.nsecsElapsed() / 1000 << "us";
+    return changed;
+}
+
+/*!
+ * Removes the files which LaTeX has written with the previous template,
+ * since they may contain commands which the new template does not define.
+ * The TikZ code and the files created by gnuplot (which only depend on the
+ * TikZ code) are kept.  The files are removed without holding m_memberLock.
+ */
+
+void TikzPreviewGenerator::removeTemplateDependentFiles()
+{
+    m_memberLock.lock();
+    const QFileInfo tikzFileInfo(m_tikzFileBaseName);
+    m_memberLock.unlock();
+    QDir workingDir(tikzFileInfo.absolutePath());
+    const QStringList fileNames =
+            workingDir.entryList(QStringList() << tikzFileInfo.fileName() + QLatin1String(".*")
+                                               << QLatin1String("ktikzunit-*")
+                                               << QLatin1String("ktikzassembly.*"),
+                                 QDir::Files);
+    for (const auto &fileName : fileNames) {
+        if (fileName.endsWith(QLatin1String(".pgf")) || fileName.endsWith(QLatin1String(".gnuplot"))
+            || fileName.endsWith(QLatin1String(".table")))
+            continue;
+        workingDir.remove(fileName);
+    }
+    const QMutexLocker lock(&m_memberLock);
+    m_writtenLatexCode.clear();
+    m_previousTikzUnitNames.clear();
+}
+
 void TikzPreviewGenerator::showFileWriteError(const QString &fileName, const QString &errorMessage)
 {
     const QString error = tr("Cannot write file \"%1\":\n%2").arg(fileName).arg(errorMessage);
@@ -376,9 +980,37 @@ void TikzPreviewGenerator::showFileWriteError(const QString &fileName, const QSt
     Q_EMIT updateLog(error, true);
 }
 
-static QString createTempLatexFile(const QString &tikzFileBaseName, const QString &templateFileName,
-                                   const QString &tikzReplaceText,
-                                   const TextCodecProfile *codecProfile)
+/*!
+ * Writes \p latexCode in the .tex file, unless the file already contains it.
+ * The file is written without holding m_memberLock.
+ */
+
+bool TikzPreviewGenerator::writeLatexFile(const QString &latexCode)
+{
+    m_memberLock.lock();
+    const QString tikzFileBaseName = m_tikzFileBaseName;
+    const bool upToDate = latexCode == m_writtenLatexCode;
+    m_memberLock.unlock();
+    if (upToDate)
+        return true;
+
+    const QString errorString =
+            createTempLatexFile(tikzFileBaseName, latexCode, textCodecProfile());
+    m_memberLock.lock();
+    // the file name may have been changed while the file was written, the
+    // file in the new directory has then not been written yet
+    if (tikzFileBaseName == m_tikzFileBaseName)
+        m_writtenLatexCode = errorString.isEmpty() ? latexCode : QString();
+    m_memberLock.unlock();
+    if (!errorString.isEmpty()) {
+        showFileWriteError(tikzFileBaseName + QLatin1String(".tex"), errorString);
+        return false;
+    }
+    return true;
+}
+
+static QString createLatexCode(const QString &templateFileName, const QString &tikzReplaceText,
+                               const TextCodecProfile *codecProfile)
 {
     const QString inputTikzCode =
             QLatin1String("\\makeatletter\n"
@@ -387,6 +1019,11 @@ static QString createTempLatexFile(const QString &tikzFileBaseName, const QStrin
                           "  \\newdimen\\ktikzorigy\n"
                           "  \\newwrite\\ktikzauxfile\n"
                           "  \\immediate\\openout\\ktikzauxfile\\jobname.ktikzaux\n"
+                          "  \\immediate\\write\\ktikzauxfile{\\@percentchar ktikzaux 2}\n"
+                          "  \\gdef\\ktikzfirstline{0}\n"
+                          "  \\let\\oldtikzpicture\\tikzpicture\n"
+                          "  \\def\\tikzpicture{\\xdef\\ktikzfirstline{\\the\\inputlineno}"
+                          "\\oldtikzpicture}\n"
                           "  \\let\\oldendtikzpicture\\endtikzpicture\n"
                           "  \\def\\endtikzpicture{%\n"
                           "    \\pgfextractx{\\ktikzorigx}{\\pgfpointxy{1}{0}}\n"
@@ -399,33 +1036,26 @@ static QString createTempLatexFile(const QString &tikzFileBaseName, const QStrin
                           "    \\pgfmathsetmacro{\\ktikzmaxy}{\\csname pgf@picmaxy\\endcsname}\n"
                           "    "
                           "\\immediate\\write\\ktikzauxfile{\\ktikzunitx;\\ktikzunity;\\ktikzminx;"
-                          "\\ktikzmaxx;\\ktikzminy;\\ktikzmaxy}\n"
+                          "\\ktikzmaxx;\\ktikzminy;\\ktikzmaxy;"
+                          "\\ktikzfirstline;\\the\\inputlineno}\n"
                           "    \\oldendtikzpicture\n"
                           "  }\n"
                           "\\fi\n"
                           "\\makeatother"
-#ifdef Q_OS_WIN32
-                          "\\input{")
-            + QFileInfo(tikzFileBaseName).baseName()
-            + QLatin1String(".pgf}"
-#else
-                          "\\input{")
-            + tikzFileBaseName
-            + QLatin1String(".pgf}"
-#endif
-                            "\\makeatletter\n"
-                            "\\ifdefined\\endtikzpicture%\n"
-                            "  \\immediate\\closeout\\ktikzauxfile\n"
-                            "\\fi\n"
-                            "\\makeatother");
-
-    File tikzTexFile(tikzFileBaseName + QLatin1String(".tex"), File::WriteOnly);
-    if (!tikzTexFile.open())
-        return tikzTexFile.errorString();
-
-    QTextStream tikzStream(tikzTexFile.file());
-    codecProfile->configureStreamEncoding(tikzStream);
+                          // a resident worker waits here until the TikZ code is written
+                          "\\ifdefined\\ktikzworker"
+                          "\\scrollmode\\read-1 to\\ktikzworker\\nonstopmode\\fi\n"
+                          // LaTeX is run in the temporary directory and the TikZ code is
+                          // in <jobname>.pgf, so that separately compiled pictures can be
+                          // given another job name
+                          "\\input{\\jobname.pgf}"
+                          "\\makeatletter\n"
+                          "\\ifdefined\\endtikzpicture%\n"
+                          "  \\immediate\\closeout\\ktikzauxfile\n"
+                          "\\fi\n"
+                          "\\makeatother");
 
+    QString latexCode;
     QFile templateFile(templateFileName);
 #ifdef KTIKZ_USE_KDE
     KFileItem templateFileItem(QUrl::fromLocalFile(templateFileName));
@@ -442,21 +1072,103 @@ static QString createTempLatexFile(const QString &tikzFileBaseName, const QStrin
             QString templateLine = templateFileStream.readLine();
             if (templateLine.indexOf(tikzReplaceText) >= 0)
                 templateLine.replace(tikzReplaceText, inputTikzCode);
-            tikzStream << templateLine << QLatin1Char('\n');
+            latexCode += templateLine + QLatin1Char('\n');
         }
     } else // use our own template
     {
-        tikzStream << QLatin1String("\\documentclass[12pt]{article}\n"
-                                    "\\usepackage{tikz}\n"
-                                    "\\usepackage{pgf}\n"
-                                    "\\usepackage[active,tightpage]{preview}\n"
-                                    "\\PreviewEnvironment[]{tikzpicture}\n"
-                                    "\\PreviewEnvironment[]{pgfpicture}\n"
-                                    "\\begin{document}\n")
-                   << inputTikzCode << QLatin1Char('\n') << QLatin1String("\\end{document}\n");
+        latexCode = QLatin1String("\\documentclass[12pt]{article}\n"
+                                  "\\usepackage{tikz}\n"
+                                  "\\usepackage{pgf}\n"
+                                  "\\usepackage[active,tightpage]{preview}\n"
+                                  "\\PreviewEnvironment[]{tikzpicture}\n"
+                                  "\\PreviewEnvironment[]{pgfpicture}\n"
+                                  "\\begin{document}\n")
+                + inputTikzCode + QLatin1Char('\n') + QLatin1String("\\end{document}\n");
     }
 
+    return latexCode;
+}
+
+/*!
+ * Splits \p tikzCode in units which each contain one of the top-level
+ * tikzpicture environments together with the code outside the pictures
+ * (e.g. \\tikzset and macro definitions).  The other pictures are replaced
+ * by empty lines, so that the line numbers in error messages remain correct.
+ * Returns an empty list if there are less than two pictures or if the code
+ * outside the pictures may produce a picture itself.
+ */
+
+static QStringList splitTikzPictures(const QString &tikzCode)
+{
+    // blank out comments, keeping the positions of the remaining code
+    QString code = tikzCode;
+    for (int i = 0; i < code.length(); ++i) {
+        if (code.at(i) == QLatin1Char('\\'))
+            ++i; // skip escaped characters such as \%
+        else if (code.at(i) == QLatin1Char('%')) {
+            while (i < code.length() && code.at(i) != QLatin1Char('\n'))
+                code[i++] = QLatin1Char(' ');
+        }
+    }
+
+    static const QRegularExpression environmentRegExp(
+            QLatin1String("\\\\(begin|end)\\s*\\{tikzpicture\\}"));
+    QVector<QPair<int, int>> pictures;
+    int depth = 0;
+    int pictureStart = 0;
+    QRegularExpressionMatchIterator it = environmentRegExp.globalMatch(code);
+    while (it.hasNext()) {
+        const QRegularExpressionMatch match = it.next();
+        if (match.captured(1) == QLatin1String("begin")) {
+            if (depth++ == 0)
+                pictureStart = match.capturedStart();
+        } else if (--depth == 0)
+            pictures << qMakePair(pictureStart, match.capturedEnd());
+        else if (depth < 0)
+            return QStringList();
+    }
+    if (depth != 0 || pictures.size() < 2)
+        return QStringList();
+
+    QString outsideCode = code;
+    for (int i = pictures.size() - 1; i >= 0; --i)
+        outsideCode.remove(pictures.at(i).first, pictures.at(i).second - pictures.at(i).first);
+    static const QRegularExpression outputRegExp(
+            QLatin1String("\\\\(tikz\\b|pgfpicture|input\\b|include|foreach|loop|begin)"));
+    if (outsideCode.contains(outputRegExp))
+        return QStringList();
+
+    QStringList units;
+    for (int i = 0; i < pictures.size(); ++i) {
+        QString unit = tikzCode;
+        for (int j = pictures.size() - 1; j >= 0; --j) {
+            if (j == i)
+                continue;
+            const int length = pictures.at(j).second - pictures.at(j).first;
+            unit.replace(pictures.at(j).first, length,
+                         QString(tikzCode.midRef(pictures.at(j).first, length)
+                                         .count(QLatin1Char('\n')),
+                                 QLatin1Char('\n')));
+        }
+        units << unit;
+    }
+    return units;
+}
+
+static QString createTempLatexFile(const QString &tikzFileBaseName, const QString &latexCode,
+                                   const TextCodecProfile *codecProfile)
+{
+    File tikzTexFile(tikzFileBaseName + QLatin1String(".tex"), File::WriteOnly);
+    if (!tikzTexFile.open())
+        return tikzTexFile.errorString();
+
+    // encode everything first, so that the file is written at once
+    QByteArray data;
+    QTextStream tikzStream(&data, QIODevice::WriteOnly);
+    codecProfile->configureStreamEncoding(tikzStream);
+    tikzStream << latexCode;
     tikzStream.flush();
+    tikzTexFile.file()->write(data);
 
     if (!tikzTexFile.close())
         return tikzTexFile.errorString();
@@ -473,12 +1185,15 @@ static QString createTempTikzFile(const QString &tikzFileBaseName, const QString
     if (!tikzFile.open(QFile::WriteOnly))
         return QString::fromUtf8("Could not open \"%1\".").arg(tikzFileBaseName);
 
-    QTextStream tikzStream(&tikzFile);
+    // encode everything first, so that the file is written at once
+    QByteArray data;
+    QTextStream tikzStream(&data, QIODevice::WriteOnly);
     codecProfile->configureStreamEncoding(tikzStream);
 
-    tikzStream << tikzCode << Qt::endl;
+    tikzStream << tikzCode << QLatin1Char('\n');
     tikzStream.flush();
 
+    tikzFile.write(data);
     tikzFile.close();
 
     qDebug() << "tikz code written to:" << tikzFileBaseName + QLatin1String(".pgf");
@@ -487,72 +1202,210 @@ static QString createTempTikzFile(const QString &tikzFileBaseName, const QString
 
 /***************************************************************************/
 
-void TikzPreviewGenerator::addToLatexSearchPath(const QString &path)
+/*!
+ * Adds \p path to the directories in which LaTeX looks for input files.
+ * Returns false if it was already in the search path.
+ */
+
+bool TikzPreviewGenerator::addToLatexSearchPath(const QString &path)
 {
-    const QMutexLocker lock(&m_memberLock);
-    const QString texinputsValue = m_processEnvironment.value(QLatin1String("TEXINPUTS"));
+    const std::shared_ptr<Settings> settings = copySettings();
+    const QString texinputsValue = settings->processEnvironment.value(QLatin1String("TEXINPUTS"));
     const QString pathWithSeparator = path + s_pathSeparator;
-    if (!texinputsValue.contains(pathWithSeparator))
-        m_processEnvironment.insert(QLatin1String("TEXINPUTS"), pathWithSeparator + texinputsValue);
+    if (texinputsValue.contains(pathWithSeparator))
+        return false;
+    settings->processEnvironment.insert(QLatin1String("TEXINPUTS"),
+                                        pathWithSeparator + texinputsValue);
+    publishSettings(settings);
+    return true;
 }
 
 void TikzPreviewGenerator::removeFromLatexSearchPath(const QString &path)
 {
-    const QMutexLocker lock(&m_memberLock);
-    QString texinputsValue = m_processEnvironment.value(QLatin1String("TEXINPUTS"));
+    const std::shared_ptr<Settings> settings = copySettings();
+    QString texinputsValue = settings->processEnvironment.value(QLatin1String("TEXINPUTS"));
     const QString pathWithSeparator = path + s_pathSeparator;
-    if (texinputsValue.contains(pathWithSeparator))
-        m_processEnvironment.insert(QLatin1String("TEXINPUTS"),
-                                    texinputsValue.remove(pathWithSeparator));
+    if (!texinputsValue.contains(pathWithSeparator))
+        return;
+    settings->processEnvironment.insert(QLatin1String("TEXINPUTS"),
+                                        texinputsValue.remove(pathWithSeparator));
+    publishSettings(settings);
 }
 
 bool TikzPreviewGenerator::runProcess(const QString &name, const QString &command,
-                                      const QStringList &arguments, const QString &workingDir)
+                                      const QStringList &arguments, const QString &workingDir,
+                                      TikzProcess *startedProcess)
 {
     QString shortLogText;
     QString longLogText;
     bool runFailed = false;
 
-    // Initialize process
+    // Initialize process; the process is followed through its signals in
+    // a local event loop, so that we notice immediately when it finishes
+    QElapsedTimer elapsedTimer;
+    elapsedTimer.start();
+    QEventLoop eventLoop;
+    QByteArray output;
+    int scannedSize = 0;
+    const bool scanOutput = name == QLatin1String("LaTeX");
+
+    // the number of processes run by all windows together is limited; all
+    // processes are run in m_thread (the exports run pdftops and pdftocairo
+    // themselves), so each run waits for a slot unless it is a resident
+    // worker, which already has one
+    Q_ASSERT(QThread::currentThread() == &m_thread);
+    const std::shared_ptr<const Settings> settings = this->settings();
+    const int cpuTimeLimit = settings->cpuTimeLimit;
+    const int timeLimit = settings->timeLimit;
+    const bool isForeground = m_isForeground.loadAcquire();
+    const bool isScheduled = !startedProcess;
+    int waitingCount = 0;
+    if (isScheduled) {
+        // the idle worker of this generator would otherwise hold a slot
+        // which it can only give back after this request has been served
+        stopResidentWorker();
+        m_waitCancelled.storeRelease(0);
+        if (isCancelled()
+            || !TikzCompileScheduler::instance()->acquire(isForeground, &m_waitCancelled,
+                                                          &waitingCount)) {
+            m_memberLock.lock();
+            m_processAborted = true;
+            m_shortLogText = QLatin1Char('[') + name + QLatin1String("] ")
+                    + tr("Process aborted.", "info process");
+            m_runFailed.storeRelease(1);
+            m_memberLock.unlock();
+            Q_EMIT updateLog(m_shortLogText, true);
+            return false;
+        }
+    }
+    const qint64 waitTime = elapsedTimer.restart();
+    if (waitingCount > 0 || waitTime > 0)
+        qDebug() << "waited" << waitTime << "ms to start" << command << "with" << waitingCount
+                 << "requests before it";
+
     m_memberLock.lock();
-    m_process = new QProcess;
     m_processAborted = false;
-    if (!workingDir.isEmpty())
-        m_process->setWorkingDirectory(workingDir);
-    m_process->setProcessEnvironment(m_processEnvironment);
-
-    // Start process
-    m_process->start(command, arguments);
+    m_processCrashed = false;
+    m_firstErrorShown = false;
+    m_stoppedAtFirstError = false;
+    m_limitExceeded = false;
+    if (startedProcess) // a resident worker which is already running
+        m_process = startedProcess;
+    else {
+        m_process = new TikzProcess;
+        m_process->setLowPriority(isScheduled && !isForeground);
+        m_process->setResourceLimits(settings->cpuTimeLimit, settings->memoryLimit);
+    }
+    TikzProcess *process = m_process;
+    connect(process, &QProcess::readyReadStandardOutput, &eventLoop,
+            [this, process, scanOutput, &output, &scannedSize]() {
+                output += process->readAllStandardOutput();
+                if (output.size() > s_maxProcessOutputSize) {
+                    const int removedSize = output.size() - s_maxProcessOutputSize;
+                    output.remove(0, removedSize);
+                    scannedSize = qMax(0, scannedSize - removedSize);
+                }
+                if (scanOutput && scanLatexOutput(output, &scannedSize))
+                    process->killProcessGroup();
+            });
+    connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), &eventLoop,
+            &QEventLoop::quit);
+    connect(process, &QProcess::errorOccurred, &eventLoop,
+            [&eventLoop, &runFailed](QProcess::ProcessError error) {
+                if (error == QProcess::FailedToStart) {
+                    runFailed = true;
+                    eventLoop.quit();
+                }
+            });
+    bool timeLimitExceeded = false;
+    QTimer timeLimitTimer;
+    timeLimitTimer.setSingleShot(true);
+    connect(&timeLimitTimer, &QTimer::timeout, &eventLoop,
+            [process, &timeLimitExceeded]() {
+                timeLimitExceeded = true;
+                process->killProcessGroup();
+            });
+    if (!startedProcess) {
+        if (!workingDir.isEmpty())
+            process->setWorkingDirectory(workingDir);
+        process->setProcessEnvironment(settings->processEnvironment);
+
+        // Start process
+        process->start(command, arguments);
+    }
+    // the request may have been cancelled before m_process was set
+    if (isScheduled && isCancelled()) {
+        process->killProcessGroup();
+        m_processAborted = true;
+    }
     m_memberLock.unlock(); // the following must not be protected by the mutex because we must be
                            // able to kill m_process
     Q_EMIT processRunning(true);
-    if (!m_process->waitForStarted(1000))
-        runFailed = true;
     qDebug() << "starting" << command + QLatin1Char(' ') + arguments.join(QLatin1String(" "));
 
     // Process is running
-    QByteArray buffer;
-    QTextStream log(&buffer);
-    while (m_process->state() != QProcess::NotRunning) {
-        // still running or starting
-        if (m_process->bytesAvailable())
-            log << m_process->readLine();
-        else
-            m_process->waitForFinished(100 /*msec*/);
+    if (!runFailed && process->state() != QProcess::NotRunning) {
+        if (timeLimit > 0)
+            timeLimitTimer.start(timeLimit * 1000);
+        eventLoop.exec(QEventLoop::ExcludeUserInputEvents);
     }
-    // Process finished
+    timeLimitTimer.stop();
+    process->disconnect(&eventLoop);
+
+    // Process finished; a resident worker has kept the slot which it took
+    // when it was started
+    if (isScheduled || startedProcess)
+        TikzCompileScheduler::instance()->release();
     Q_EMIT processRunning(false);
-    if (m_process->bytesAvailable())
-        log << m_process->readLine(m_process->bytesAvailable());
-    log.seek(0);
+    output += process->readAllStandardOutput();
+    const QString processLog = QTextStream(&output).readAll();
+    const qint64 elapsedTime = elapsedTimer.elapsed();
+    qDebug() << command << "finished after" << elapsedTime << "ms";
 
-    // Postprocessing
+    // Postprocessing; the log is parsed after the lock has been released
+    bool parseLog = false;
     m_memberLock.lock();
+    // the process is killed with SIGXCPU or SIGKILL when it exceeds its CPU
+    // time, which cannot have happened when it has not run that long; when
+    // it exceeds its memory limit, it fails to allocate more memory
+    QString limitText;
+    if (timeLimitExceeded)
+        limitText = tr("Error: the time limit of %n second(s) has been exceeded.",
+                       "info process", timeLimit);
+    else if (!m_processAborted && !m_stoppedAtFirstError && !runFailed && cpuTimeLimit > 0
+             && m_process->exitStatus() == QProcess::CrashExit
+             && elapsedTime >= cpuTimeLimit * 1000)
+        limitText = tr("Error: the CPU time limit of %n second(s) has been exceeded.",
+                       "info process", cpuTimeLimit);
+    else if (!m_processAborted && !m_stoppedAtFirstError && !runFailed
+             && settings->memoryLimit > 0
+             && (m_process->exitStatus() == QProcess::CrashExit || m_process->exitCode() != 0)
+             && (output.contains("memory exhausted") || output.contains("out of memory")))
+        limitText = tr("Error: the memory limit of %1 MiB has been exceeded.", "info process")
+                            .arg(settings->memoryLimit);
+    m_limitExceeded = !limitText.isEmpty();
+
     if (m_processAborted) {
         shortLogText = QLatin1Char('[') + name + QLatin1String("] ")
                 + tr("Process aborted.", "info process");
         longLogText = shortLogText;
         runFailed = true;
+    } else if (m_limitExceeded) {
+        shortLogText = QLatin1Char('[') + name + QLatin1String("] ") + limitText;
+        m_logText = processLog;
+        longLogText = shortLogText
+                + tr("\nCommand: %1", "info process")
+                          .arg(command + QLatin1Char(' ') + arguments.join(QLatin1String(" ")))
+                + QLatin1String("\n\n");
+        parseLog = true;
+        qWarning() << "Error:" << qPrintable(command) << "exceeded its resource limits";
+        runFailed = true;
+    } else if (m_stoppedAtFirstError) {
+        shortLogText = QLatin1Char('[') + name + QLatin1String("] ")
+                + tr("Process stopped at the first error.", "info process");
+        m_logText = processLog;
+        parseLog = true;
+        runFailed = true;
     } else if (runFailed) // if the process could not be started
     {
         shortLogText = QLatin1Char('[') + name + QLatin1String("] ")
@@ -563,7 +1416,14 @@ bool TikzPreviewGenerator::runProcess(const QString &name, const QString &comman
     } else if (m_process->exitCode() == 0) {
         shortLogText = QLatin1Char('[') + name + QLatin1String("] ")
                 + tr("Process finished successfully.", "info process");
-        longLogText = shortLogText;
+        longLogText = shortLogText
+                + tr("\nElapsed time: %1 ms", "info process").arg(elapsedTime);
+        if (waitingCount > 0 || waitTime > 0)
+            longLogText += tr("\nWaited %1 ms for other LaTeX processes "
+                              "(%2 requests were waiting).",
+                              "info process")
+                                   .arg(waitTime)
+                                   .arg(waitingCount);
         runFailed = false;
     } else {
         shortLogText = QLatin1Char('[') + name + QLatin1String("] ")
@@ -573,15 +1433,19 @@ bool TikzPreviewGenerator::runProcess(const QString &name, const QString &comman
                           .arg(command + QLatin1Char(' ') + arguments.join(QLatin1String(" ")));
         qWarning() << "Error:" << qPrintable(command)
                    << "run failed with exit code:" << m_process->exitCode();
-        m_logText = log.readAll();
+        m_logText = processLog;
         runFailed = true;
     }
+    m_processCrashed = !m_processAborted && !m_stoppedAtFirstError && !m_limitExceeded
+            && m_process->exitStatus() == QProcess::CrashExit;
     delete m_process;
     m_process = 0;
     m_shortLogText = shortLogText;
-    m_runFailed = runFailed;
+    m_runFailed.storeRelease(runFailed);
     m_memberLock.unlock();
 
+    if (parseLog)
+        longLogText += getParsedLogText(processLog);
     if (runFailed)
         Q_EMIT showErrorMessage(shortLogText);
     Q_EMIT updateLog(longLogText, runFailed);
@@ -589,49 +1453,215 @@ bool TikzPreviewGenerator::runProcess(const QString &name, const QString &comman
     return !runFailed;
 }
 
+/*!
+ * Looks for an error message in the lines of \p output after \p scannedSize
+ * which have been completely written by LaTeX, and shows the first one
+ * immediately.  Returns true if LaTeX must be stopped because of this error.
+ */
+
+bool TikzPreviewGenerator::scanLatexOutput(const QByteArray &output, int *scannedSize)
+{
+    int lineEnd = output.indexOf('\n', *scannedSize);
+    while (lineEnd >= 0) {
+        const QString line =
+                QString::fromLocal8Bit(output.constData() + *scannedSize, lineEnd - *scannedSize);
+        *scannedSize = lineEnd + 1;
+        lineEnd = output.indexOf('\n', *scannedSize);
+
+        TikzLogScanner::Diagnostic diagnostic;
+        if (m_firstErrorShown || !TikzLogScanner::scanLine(QStringRef(&line), &diagnostic)
+            || (diagnostic.kind != TikzLogScanner::FileLineError
+                && diagnostic.kind != TikzLogScanner::TexError))
+            continue;
+        m_firstErrorShown = true;
+        const QString message = line.mid(diagnostic.messageOffset).trimmed();
+        const QString errorText = diagnostic.sourceLine < 0
+                ? QLatin1String("[LaTeX] ") + message
+                : QLatin1String("[LaTeX] Line ") + QString::number(diagnostic.sourceLine)
+                        + QLatin1String(": ") + message;
+        Q_EMIT showErrorMessage(errorText);
+
+        if (settings()->abortOnFirstError) {
+            const QMutexLocker lock(&m_memberLock);
+            m_stoppedAtFirstError = true;
+            return true;
+        }
+    }
+    return false;
+}
+
 void TikzPreviewGenerator::abortProcess()
 {
+    cancelRequests(m_latestRequest.loadAcquire());
+}
+
+/*!
+ * Cancels the request which is being handled if it is not newer than
+ * \p lastCancelledRequest.  Its process is killed and the stages of
+ * createPreview() which have not started yet are skipped, so that no
+ * outdated preview is shown.  A newer request which has already been
+ * started is not affected.
+ */
+
+void TikzPreviewGenerator::cancelRequests(int lastCancelledRequest)
+{
+    m_cancelledRequest.storeRelease(lastCancelledRequest);
+    if (!isCancelled())
+        return;
+
+    // stop waiting for the compile scheduler if this has not been done yet
+    m_waitCancelled.storeRelease(1);
+    TikzCompileScheduler::instance()->wakeAll();
+
+    const QMutexLocker lock(&m_memberLock);
     if (m_process) {
-        m_process->kill();
+        m_process->killProcessGroup();
         m_processAborted = true;
     }
 }
 
+/*!
+ * Returns true if the request which is being handled has been cancelled,
+ * i.e. it has been superseded by a newer one or aborted by the user.
+ */
+
+bool TikzPreviewGenerator::isCancelled() const
+{
+    return m_generation.loadAcquire() <= m_cancelledRequest.loadAcquire();
+}
+
 /***************************************************************************/
 
-bool TikzPreviewGenerator::generateEpsFile(int page)
-{
-    QStringList pdftopsArguments;
-    pdftopsArguments << QLatin1String("-f") << QString::number(page + 1) << QLatin1String("-l")
-                     << QString::number(page + 1) << QLatin1String("-eps")
-                     << m_tikzFileBaseName + QLatin1String(".pdf")
-                     << m_tikzFileBaseName + QLatin1String(".eps");
-    return runProcess(QLatin1String("pdftops"), m_pdftopsCommand, pdftopsArguments);
-    /*
-            int width = m_tikzPdfDoc->page(page)->pageSize().width();
-            int height = m_tikzPdfDoc->page(page)->pageSize().height();
-
-            Poppler::PSConverter *psConverter = m_tikzPdfDoc->psConverter();
-            psConverter->setOutputFileName(m_tikzFileBaseName + QLatin1String(".eps"));
-            psConverter->setPageList(QList<int>() << page+1);
-            psConverter->setPaperWidth(width);
-            psConverter->setPaperHeight(height);
-            if (psConverter->convert())
-            {
-                    delete psConverter;
-                    return true;
-            }
-            delete psConverter;
-            return false;
-    */
+/*!
+ * Creates a directory next to the files of the preview in which a job
+ * (e.g. an export) can write its files while the preview is regenerated;
+ * \p purpose is only used to recognize the directory.  Returns the path of
+ * the directory, or an empty string if it cannot be created.  The caller
+ * must remove the directory with releaseSlot() when the job is finished.
+ */
+
+QString TikzPreviewGenerator::createSlot(const QString &purpose)
+{
+    static QAtomicInt slotCount;
+
+    removeStaleSlots();
+    m_memberLock.lock();
+    const QString workingDir = QFileInfo(m_tikzFileBaseName).absolutePath();
+    m_memberLock.unlock();
+    const QString slotDir = workingDir + QLatin1String("/slot-") + purpose + QLatin1Char('-')
+            + QString::number(slotCount.fetchAndAddOrdered(1) + 1);
+    QDir(slotDir).removeRecursively();
+    return QDir().mkpath(slotDir) ? slotDir : QString();
 }
 
-bool TikzPreviewGenerator::generatePdfFile(const QString &tikzFileBaseName,
-                                           const QString &latexCommand, bool useShellEscaping)
+void TikzPreviewGenerator::releaseSlot(const QString &slotDir)
 {
-    // remove log file before running pdflatex again
-    QDir::root().remove(tikzFileBaseName + QLatin1String(".log"));
+    if (!slotDir.isEmpty())
+        QDir(slotDir).removeRecursively();
+}
+
+/*!
+ * Removes the slots which have not been released (e.g. because a job was
+ * interrupted) and have not been changed for a long time.
+ */
+
+void TikzPreviewGenerator::removeStaleSlots()
+{
+    m_memberLock.lock();
+    const QDir workingDir(QFileInfo(m_tikzFileBaseName).absolutePath());
+    m_memberLock.unlock();
+    const QDateTime staleTime = QDateTime::currentDateTime().addSecs(-s_maxSlotAge);
+    const QFileInfoList slotInfos = workingDir.entryInfoList(
+            QStringList() << QLatin1String("slot-*"), QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const auto &slotInfo : slotInfos) {
+        if (slotInfo.lastModified() < staleTime)
+            QDir(slotInfo.absoluteFilePath()).removeRecursively();
+    }
+}
 
+/*!
+ * Writes the PDF data of the preview to \p fileName.  The data is that of
+ * the preview which is shown, even if a new PDF file is being generated.
+ */
+
+bool TikzPreviewGenerator::writePdfFile(const QString &fileName) const
+{
+    m_memberLock.lock();
+    const QByteArray tikzPdfData = m_tikzPdfData;
+    m_memberLock.unlock();
+
+    QFile pdfFile(fileName);
+    return !tikzPdfData.isEmpty() && pdfFile.open(QIODevice::WriteOnly)
+            && pdfFile.write(tikzPdfData) == tikzPdfData.size();
+}
+
+/*!
+ * Converts \p page (counting from 0) of the preview to the EPS file
+ * \p epsFileName.
+ */
+
+bool TikzPreviewGenerator::generateEpsFile(int page, const QString &epsFileName)
+{
+    return generateEpsFiles(QList<int>() << page, QStringList() << epsFileName);
+}
+
+/*!
+ * Converts each page in \p pages (counting from 0) of the preview to the EPS
+ * file at the same position in \p epsFileNames.  The pages are converted in
+ * parallel by Poppler; pdftops is only run for the pages which Poppler fails
+ * to convert.
+ */
+
+bool TikzPreviewGenerator::generateEpsFiles(const QList<int> &pages,
+                                            const QStringList &epsFileNames)
+{
+    m_memberLock.lock();
+    const QByteArray tikzPdfData = m_tikzPdfData;
+    m_memberLock.unlock();
+    const std::shared_ptr<const Settings> settings = this->settings();
+
+    const QList<int> failedPages = TikzEpsConverter::convert(tikzPdfData, pages, epsFileNames);
+    if (failedPages.isEmpty())
+        return true;
+
+    // pdftops converts a copy of the PDF data in its own slot, because the
+    // PDF file of the preview may be replaced while it is running; it does
+    // not use runProcess(), which may be running LaTeX in the meantime, so
+    // it is killed when it exceeds the limits since nothing can abort it
+    const int timeLimit = settings->timeLimit > 0 ? settings->timeLimit : s_pdftopsTimeLimit;
+    const QString slotDir = createSlot(QLatin1String("eps"));
+    const QString pdfFileName = slotDir + QLatin1String("/preview.pdf");
+    bool success = !slotDir.isEmpty() && writePdfFile(pdfFileName);
+    for (int page : failedPages) {
+        if (!success)
+            break;
+        qWarning() << "Error: Poppler could not convert page" << page + 1
+                   << "to EPS, running pdftops";
+        QStringList pdftopsArguments;
+        pdftopsArguments << QLatin1String("-f") << QString::number(page + 1)
+                         << QLatin1String("-l") << QString::number(page + 1)
+                         << QLatin1String("-eps") << pdfFileName
+                         << epsFileNames.at(pages.indexOf(page));
+        TikzProcess process;
+        process.setResourceLimits(settings->cpuTimeLimit, settings->memoryLimit);
+        process.setProcessEnvironment(settings->processEnvironment);
+        process.start(settings->pdftopsCommand, pdftopsArguments);
+        const bool finished = process.waitForFinished(timeLimit * 1000);
+        if (!finished && process.state() != QProcess::NotRunning) {
+            qWarning() << "Error: pdftops did not finish within" << timeLimit << "seconds";
+            process.killProcessGroup();
+            process.waitForFinished(1000);
+        }
+        success = finished && process.exitStatus() == QProcess::NormalExit
+                && process.exitCode() == 0;
+    }
+    releaseSlot(slotDir);
+    return success;
+}
+
+static QStringList latexArguments(const QString &latexCommand, bool useShellEscaping,
+                                  const QString &formatFile)
+{
     QStringList arguments;
     if (latexCommand == QLatin1String("context")) {
         // ConTeXt doesn’t support enabling \write18 via command line
@@ -639,14 +1669,593 @@ bool TikzPreviewGenerator::generatePdfFile(const QString &tikzFileBaseName,
     } else {
         if (useShellEscaping)
             arguments << QLatin1String("-shell-escape");
+        // the .fls file lists the files read by LaTeX, see updateDependencies()
+        arguments << QLatin1String("-recorder");
         arguments << QLatin1String("-halt-on-error") << QLatin1String("-file-line-error")
                   << QLatin1String("-interaction") << QLatin1String("nonstopmode");
+        if (!formatFile.isEmpty()) // the .tex file only contains the body of the template
+            arguments << QLatin1String("-fmt=") + formatFile;
+    }
+    return arguments;
+}
+
+/*!
+ * Returns the lines of \p auxFileName in which TikZ stores the positions of
+ * remembered pictures, or an empty byte array if there are none.
+ */
+
+static QByteArray auxPositionMarks(const QString &auxFileName)
+{
+    QByteArray positionMarks;
+    QFile auxFile(auxFileName);
+    if (!auxFile.open(QIODevice::ReadOnly))
+        return positionMarks;
+    while (!auxFile.atEnd()) {
+        const QByteArray line = auxFile.readLine();
+        if (line.contains("\\pgfsyspdfmark"))
+            positionMarks += line;
     }
+    return positionMarks;
+}
+
+/*!
+ * Returns true if the run of LaTeX which has written \p logFileName and
+ * \p auxFileName must be repeated: LaTeX or a package asks for it in the
+ * log (e.g. because labels have changed), or the positions of remembered
+ * pictures which the run has written are different from the positions
+ * \p readPositionMarks which it has read at its start (and used).
+ */
+
+static bool needsRerun(const QString &logFileName, const QString &auxFileName,
+                       const QByteArray &readPositionMarks)
+{
+    static const QRegularExpression rerunRegExp(
+            QLatin1String("Rerun to get|Please rerun|Rerun LaTeX|\\(rerunfilecheck\\)"),
+            QRegularExpression::CaseInsensitiveOption);
+
+    QFile logFile(logFileName);
+    if (logFile.open(QIODevice::ReadOnly | QIODevice::Text)
+        && rerunRegExp.match(QString::fromLocal8Bit(logFile.readAll())).hasMatch())
+        return true;
+
+    const QByteArray positionMarks = auxPositionMarks(auxFileName);
+    return !positionMarks.isEmpty() && positionMarks != readPositionMarks;
+}
+
+/*!
+ * Compiles the template to a PDF file and repeats this (at most
+ * s_maxLatexPasses times in total) as long as the output is not final yet,
+ * e.g. when pictures with "remember picture" refer to each other.  Figures
+ * which need only one run are not compiled twice.
+ */
+
+bool TikzPreviewGenerator::generatePdfFile(const QString &tikzFileBaseName,
+                                           const QString &latexCommand, bool useShellEscaping,
+                                           const QString &formatFile, const QString &jobName)
+{
+    const QString auxBaseName = jobName.isEmpty()
+            ? tikzFileBaseName
+            : QFileInfo(tikzFileBaseName).absolutePath() + QLatin1Char('/') + jobName;
+    const QString auxFileName = auxBaseName + QLatin1String(".aux");
+    QByteArray readPositionMarks;
+
+    bool success = runLatexPass(tikzFileBaseName, latexCommand, useShellEscaping, formatFile,
+                                jobName, &readPositionMarks);
+    for (int pass = 2; success && !isCancelled() && pass <= s_maxLatexPasses
+         && needsRerun(auxBaseName + QLatin1String(".log"), auxFileName, readPositionMarks);
+         ++pass) {
+        qDebug() << "rerunning LaTeX, pass" << pass;
+        success = runLatexPass(tikzFileBaseName, latexCommand, useShellEscaping, formatFile,
+                               jobName, &readPositionMarks);
+    }
+    return success;
+}
+
+/*!
+ * Runs LaTeX once on the template.  \p readPositionMarks is set to the
+ * positions of remembered pictures which LaTeX reads from the .aux file at
+ * the start of the run; a resident worker has read them when it was started.
+ */
+
+bool TikzPreviewGenerator::runLatexPass(const QString &tikzFileBaseName,
+                                        const QString &latexCommand, bool useShellEscaping,
+                                        const QString &formatFile, const QString &jobName,
+                                        QByteArray *readPositionMarks)
+{
+    QStringList arguments = latexArguments(latexCommand, useShellEscaping, formatFile);
+    const QString workingDir = QFileInfo(tikzFileBaseName).absolutePath();
+
+    Q_EMIT updateLog(QLatin1String("[LaTeX] ") + tr("Running...", "info process"),
+                     false); // runFailed = false
+
+    if (!jobName.isEmpty()) {
+        // a single picture is compiled into <jobName>.pdf, the template
+        // inputs the TikZ code from <jobName>.pgf
+        stopResidentWorker();
+        QDir::root().remove(workingDir + QLatin1Char('/') + jobName + QLatin1String(".log"));
+        *readPositionMarks =
+                auxPositionMarks(workingDir + QLatin1Char('/') + jobName + QLatin1String(".aux"));
+        arguments << QLatin1String("-jobname=") + jobName
+                  << QFileInfo(tikzFileBaseName + QLatin1String(".tex")).fileName();
+        return runProcess(QLatin1String("LaTeX"), latexCommand, arguments, workingDir);
+    }
+
+    // a resident worker has already loaded the format and is waiting for
+    // a line on its standard input before it inputs the TikZ code
+    m_memberLock.lock();
+    TikzProcess *worker = m_workerProcess;
+    const bool workerIsUsable = worker && worker->state() == QProcess::Running
+            && m_workerKey == latexCommand + arguments.join(QLatin1Char(' ')) + workingDir;
+    const QByteArray workerPositionMarks = m_workerPositionMarks;
+    m_workerProcess = 0;
+    m_memberLock.unlock();
+    if (worker)
+        TikzCompileScheduler::instance()->setBusy(this);
+    if (workerIsUsable) {
+        *readPositionMarks = workerPositionMarks;
+        worker->write("\n");
+        worker->waitForBytesWritten(1000);
+        const bool success = runProcess(QLatin1String("LaTeX"), latexCommand, arguments,
+                                        workingDir, worker);
+        if (success || !m_processCrashed)
+            return success;
+        qWarning() << "Error: the resident LaTeX worker crashed, running LaTeX again";
+    } else if (worker) {
+        worker->killProcessGroup();
+        worker->waitForFinished(1000);
+        delete worker;
+        TikzCompileScheduler::instance()->release();
+    }
+
+    // remove log file before running pdflatex again
+    QDir::root().remove(tikzFileBaseName + QLatin1String(".log"));
+    *readPositionMarks = auxPositionMarks(tikzFileBaseName + QLatin1String(".aux"));
+
     // We run the command in the temp dir, so using the file name is enough
     arguments << QFileInfo(tikzFileBaseName + QLatin1String(".tex")).fileName();
+    return runProcess(QLatin1String("LaTeX"), latexCommand, arguments, workingDir);
+}
+
+/*!
+ * Compiles the TikZ code in draft mode (in which pdfTeX and LuaTeX do not
+ * write a PDF file) if the draft pre-check is enabled.  Returns false if
+ * LaTeX fails, the PDF file is then not generated; \p elapsedTime is set to
+ * the duration of the check, or to -1 if the check is skipped.  The check is
+ * skipped when a resident worker is waiting, since the worker finishes the
+ * full run sooner than a new process can check the code.
+ */
+
+bool TikzPreviewGenerator::runDraftPreCheck(const QString &tikzFileBaseName,
+                                            const QString &latexCommand, bool useShellEscaping,
+                                            const QString &formatFile, qint64 *elapsedTime)
+{
+    *elapsedTime = -1;
+    const QString engineName = QFileInfo(latexCommand).completeBaseName();
+    m_memberLock.lock();
+    const bool useDraftPreCheck = m_jobSettings->useDraftPreCheck && !m_workerProcess
+            && (engineName == QLatin1String("pdflatex")
+                || engineName == QLatin1String("lualatex"));
+    m_memberLock.unlock();
+    if (!useDraftPreCheck)
+        return true;
+
+    Q_EMIT updateLog(QLatin1String("[LaTeX] ")
+                             + tr("Checking the code in draft mode...", "info process"),
+                     false); // runFailed = false
+
+    QStringList arguments = latexArguments(latexCommand, useShellEscaping, formatFile);
+    arguments << QLatin1String("-draftmode")
+              << QFileInfo(tikzFileBaseName + QLatin1String(".tex")).fileName();
+    QDir::root().remove(tikzFileBaseName + QLatin1String(".log"));
+    QElapsedTimer timer;
+    timer.start();
+    const bool success = runProcess(QLatin1String("LaTeX"), latexCommand, arguments,
+                                    QFileInfo(tikzFileBaseName).absolutePath());
+    *elapsedTime = timer.elapsed();
+    return success;
+}
+
+/*!
+ * Returns the command which compiles to DVI with the same TeX engine as
+ * \p latexCommand, or an empty string if there is no such command.
+ */
+
+static QString dviLatexCommand(const QString &latexCommand)
+{
+    const QFileInfo commandInfo(latexCommand);
+    QString dviCommand;
+    if (commandInfo.completeBaseName() == QLatin1String("pdflatex"))
+        dviCommand = QLatin1String("latex");
+    else if (commandInfo.completeBaseName() == QLatin1String("lualatex"))
+        dviCommand = QLatin1String("dvilualatex");
+    else
+        return QString();
+    if (!commandInfo.suffix().isEmpty())
+        dviCommand += QLatin1Char('.') + commandInfo.suffix();
+    return latexCommand.contains(QLatin1Char('/'))
+            ? commandInfo.path() + QLatin1Char('/') + dviCommand
+            : dviCommand;
+}
+
+/*!
+ * Compiles the template to a DVI file, converts each page of it to an SVG
+ * file with dvisvgm and shows these pages in the preview.  Returns false if
+ * LaTeX fails, in which case the caller falls back to the PDF run; if only
+ * the conversion fails, the preview is not updated until the PDF file has
+ * been generated.
+ */
+
+bool TikzPreviewGenerator::generateSvgFiles(const QString &tikzFileBaseName,
+                                            const QString &latexCommand, bool useShellEscaping)
+{
+    const QFileInfo tikzFileInfo(tikzFileBaseName);
+    const QString workingDir = tikzFileInfo.absolutePath();
+    const QString baseName = tikzFileInfo.fileName();
 
     Q_EMIT updateLog(QLatin1String("[LaTeX] ") + tr("Running...", "info process"),
                      false); // runFailed = false
-    return runProcess(QLatin1String("LaTeX"), latexCommand, arguments,
-                      QFileInfo(tikzFileBaseName).absolutePath());
+
+    // a resident worker has opened the log and auxiliary files
+    stopResidentWorker();
+    QDir::root().remove(tikzFileBaseName + QLatin1String(".log"));
+    QDir dir(workingDir);
+    const QStringList oldSvgFileNames =
+            dir.entryList(QStringList() << baseName + QLatin1String("-*.svg"), QDir::Files);
+    for (const auto &svgFileName : oldSvgFileNames)
+        dir.remove(svgFileName);
+
+    // TikZ writes the graphics as SVG code in the DVI file, which dvisvgm
+    // converts more accurately than PostScript code
+    QStringList arguments = latexArguments(dviLatexCommand(latexCommand), useShellEscaping,
+                                           QString());
+    arguments << QLatin1String("\\def\\pgfsysdriver{pgfsys-dvisvgm.def}\\input{") + baseName
+                    + QLatin1String(".tex}");
+    if (!runProcess(QLatin1String("LaTeX"), dviLatexCommand(latexCommand), arguments,
+                    workingDir))
+        return false;
+
+    const QString dvisvgmCommand = m_jobSettings->dvisvgmCommand;
+    QStringList dvisvgmArguments;
+    dvisvgmArguments << QLatin1String("--no-fonts") << QLatin1String("--page=1-")
+                     << QLatin1String("--output=%f-%p.svg") << baseName + QLatin1String(".dvi");
+    if (!runProcess(QLatin1String("dvisvgm"), dvisvgmCommand, dvisvgmArguments, workingDir)) {
+        qWarning() << "Error: dvisvgm could not convert the DVI file, waiting for the PDF file";
+        return true;
+    }
+
+    // dvisvgm pads the page numbers with zeros to the width of the largest
+    // one, so sorting the file names sorts the pages
+    const QStringList svgFileNames = dir.entryList(
+            QStringList() << baseName + QLatin1String("-*.svg"), QDir::Files, QDir::Name);
+    QList<QByteArray> svgPages;
+    for (const auto &svgFileName : svgFileNames) {
+        QFile svgFile(dir.filePath(svgFileName));
+        if (!svgFile.open(QIODevice::ReadOnly))
+            return true;
+        svgPages << svgFile.readAll();
+    }
+    if (svgPages.isEmpty() || isCancelled())
+        return true;
+
+    m_memberLock.lock();
+    const QString tikzCode = m_tikzCode;
+    m_memberLock.unlock();
+    const QVector<TikzPictureMetrics> tikzPictureMetrics =
+            TikzPictureMetrics::read(tikzFileBaseName + QLatin1String(".ktikzaux"), tikzCode);
+    m_memberLock.lock();
+    m_tikzPictureMetrics = tikzPictureMetrics;
+    Q_EMIT svgUpdated(svgPages, m_tikzPictureMetrics);
+    m_memberLock.unlock();
+    return true;
+}
+
+/*!
+ * Returns the root directories of the trees of the TeX installation (with a
+ * trailing slash), as reported by kpsewhich in \p environment.  The files in
+ * them only change when the installation is updated.  The personal tree
+ * TEXMFHOME and other trees in which the user keeps files are not included.
+ * The directories are looked up once, they do not change in a session.
+ */
+
+static QStringList texInstallationDirs(const QProcessEnvironment &environment)
+{
+    static const QStringList installationDirs = [&environment]() {
+        QStringList dirs;
+        const char *const variables[] = { "TEXMFDIST", "TEXMFMAIN", "TEXMFSYSVAR", "TEXMFVAR" };
+        for (const char *variable : variables) {
+            QProcess kpsewhich;
+            kpsewhich.setProcessEnvironment(environment);
+            kpsewhich.start(QLatin1String("kpsewhich"),
+                            QStringList() << QLatin1String("-var-value=")
+                                            + QLatin1String(variable));
+            if (!kpsewhich.waitForFinished(5000)) {
+                kpsewhich.kill();
+                kpsewhich.waitForFinished(1000);
+                continue;
+            }
+            const QStringList values =
+                    QString::fromLocal8Bit(kpsewhich.readAllStandardOutput())
+                            .trimmed()
+                            .split(s_pathSeparator, Qt::SkipEmptyParts);
+            for (const auto &value : values) {
+                const QFileInfo dirInfo(value);
+                dirs << QDir::cleanPath(dirInfo.absoluteFilePath()) + QLatin1Char('/');
+                if (dirInfo.exists())
+                    dirs << dirInfo.canonicalFilePath() + QLatin1Char('/');
+            }
+        }
+        dirs.removeDuplicates();
+        qDebug() << "TeX installation directories:" << dirs;
+        return dirs;
+    }();
+    return installationDirs;
+}
+
+/*!
+ * Returns the files which LaTeX has read according to the recorder file
+ * \p flsFileName, except for the files in the directory in which LaTeX is
+ * run and those in \p installationDirs.  These are the files (data tables,
+ * styles, ...) which the user may change while the TikZ code is unchanged.
+ */
+
+static QStringList recordedDependencies(const QString &flsFileName,
+                                        const QStringList &installationDirs)
+{
+    QStringList dependencies;
+    QFile flsFile(flsFileName);
+    if (!flsFile.open(QIODevice::ReadOnly | QIODevice::Text))
+        return dependencies;
+
+    const QFileInfo workingDirInfo(QFileInfo(flsFileName).absolutePath());
+    const QString workingDir = workingDirInfo.absoluteFilePath() + QLatin1Char('/');
+    const QString canonicalWorkingDir = workingDirInfo.canonicalFilePath() + QLatin1Char('/');
+    QDir currentDir(workingDirInfo.absoluteFilePath());
+    while (!flsFile.atEnd()) {
+        const QString line = QString::fromLocal8Bit(flsFile.readLine()).trimmed();
+        if (line.startsWith(QLatin1String("PWD "))) {
+            currentDir.setPath(line.mid(4));
+            continue;
+        }
+        if (!line.startsWith(QLatin1String("INPUT ")))
+            continue;
+        const QString fileName = QDir::cleanPath(currentDir.absoluteFilePath(line.mid(6)));
+        if (fileName.startsWith(workingDir) || fileName.startsWith(canonicalWorkingDir))
+            continue;
+        bool isInstallationFile = false;
+        for (const auto &installationDir : installationDirs)
+            isInstallationFile = isInstallationFile || fileName.startsWith(installationDir);
+        if (!isInstallationFile)
+            dependencies << fileName;
+    }
+    return dependencies;
+}
+
+/*!
+ * Returns the recorder files written by the last run of LaTeX (by the runs
+ * for the separately compiled pictures if \p incremental is true).
+ */
+
+QStringList TikzPreviewGenerator::recorderFileNames(bool incremental) const
+{
+    m_memberLock.lock();
+    const QString tikzFileBaseName = m_tikzFileBaseName;
+    m_memberLock.unlock();
+
+    QStringList flsFileNames;
+    flsFileNames << tikzFileBaseName + QLatin1String(".fls");
+    if (incremental) {
+        const QString workingDir = QFileInfo(tikzFileBaseName).absolutePath();
+        for (const auto &unitName : qAsConst(m_previousTikzUnitNames))
+            flsFileNames << workingDir + QLatin1Char('/') + unitName + QLatin1String(".fls");
+    }
+    return flsFileNames;
+}
+
+/*!
+ * Collects the files read by the last run of LaTeX from the recorder files.
+ * Returns true and emits dependenciesChanged() if they differ from the
+ * files read by the previous run.
+ */
+
+bool TikzPreviewGenerator::updateDependencies(bool incremental)
+{
+    QStringList dependencies;
+    const QStringList installationDirs = texInstallationDirs(m_jobSettings->processEnvironment);
+    const QStringList flsFileNames = recorderFileNames(incremental);
+    for (const auto &flsFileName : flsFileNames)
+        dependencies << recordedDependencies(flsFileName, installationDirs);
+    dependencies.removeDuplicates();
+    dependencies.sort();
+
+    const QMutexLocker lock(&m_memberLock);
+    if (dependencies == m_dependencies)
+        return false;
+    m_dependencies = dependencies;
+    Q_EMIT dependenciesChanged(dependencies);
+    return true;
+}
+
+/*!
+ * Compiles each of the pictures in \p tikzPictureCodes separately, unless it
+ * has already been compiled during a previous run with the same template,
+ * and puts the resulting pages together in the PDF file.  \p logFileBaseName
+ * is set to the base name of the log file of the last run of LaTeX.
+ */
+
+bool TikzPreviewGenerator::generateIncrementalPdfFile(const QStringList &tikzPictureCodes,
+                                                      const QString &formatFile,
+                                                      QString *logFileBaseName)
+{
+    const std::shared_ptr<const Settings> settings = m_jobSettings;
+    const QString latexCommand = settings->latexCommand;
+    const bool useShellEscaping = settings->useShellEscaping;
+    m_memberLock.lock();
+    const QString tikzFileBaseName = m_tikzFileBaseName;
+    const QString workingDir = QFileInfo(tikzFileBaseName).absolutePath();
+    QByteArray templateKey = m_latexCode.toUtf8();
+    templateKey += '\n' + latexCommand.toUtf8() + (useShellEscaping ? "\n1\n" : "\n0\n")
+            + settings->processEnvironment.value(QLatin1String("TEXINPUTS")).toUtf8() + '\n'
+            + TikzCompileCache::dependencyStamp(m_dependencies) + '\n';
+    m_memberLock.unlock();
+
+    QStringList unitNames;
+    for (const auto &tikzPictureCode : tikzPictureCodes) {
+        const QByteArray hash = QCryptographicHash::hash(templateKey + tikzPictureCode.toUtf8(),
+                                                         QCryptographicHash::Sha1);
+        unitNames << QLatin1String("ktikzunit-") + QString::fromLatin1(hash.toHex().left(16));
+    }
+
+    // compile the pictures which have changed since the previous runs
+    int compiledCount = 0;
+    for (int i = 0; i < unitNames.size(); ++i) {
+        const QString unitBaseName = workingDir + QLatin1Char('/') + unitNames.at(i);
+        if (QFileInfo::exists(unitBaseName + QLatin1String(".pdf"))) {
+            if (compiledCount == 0)
+                *logFileBaseName = unitBaseName;
+            continue;
+        }
+        const QString errorString = createTempTikzFile(unitBaseName, tikzPictureCodes.at(i),
+                                                       textCodecProfile());
+        if (!errorString.isEmpty()) {
+            showFileWriteError(unitBaseName + QLatin1String(".pgf"), errorString);
+            return false;
+        }
+        *logFileBaseName = unitBaseName;
+        ++compiledCount;
+        if (!generatePdfFile(tikzFileBaseName, latexCommand, useShellEscaping, formatFile,
+                             unitNames.at(i))) {
+            // never reuse the output of a failed or aborted run
+            QFile::remove(unitBaseName + QLatin1String(".pdf"));
+            return false;
+        }
+    }
+
+    // the coordinates of all pictures, in the order of the pages
+    QFile tikzAuxFile(tikzFileBaseName + QLatin1String(".ktikzaux"));
+    if (tikzAuxFile.open(QIODevice::WriteOnly)) {
+        for (const auto &unitName : qAsConst(unitNames)) {
+            QFile unitAuxFile(workingDir + QLatin1Char('/') + unitName
+                              + QLatin1String(".ktikzaux"));
+            if (unitAuxFile.open(QIODevice::ReadOnly))
+                tikzAuxFile.write(unitAuxFile.readAll());
+        }
+        tikzAuxFile.close();
+    }
+
+    // put the pages together with pdfTeX; a unit which does not result in
+    // exactly one page (e.g. because the template does not use the preview
+    // package as expected) makes this fail, and then everything is compiled
+    // in one run
+    QString assemblyCode = QLatin1String(
+            "\\pdfoutput=1\n"
+            "\\pdfhorigin=0pt \\pdfvorigin=0pt\n"
+            "\\def\\ktikzinclude#1{\\pdfximage{#1.pdf}%\n"
+            "  \\ifnum\\pdflastximagepages=1 \\else\\errmessage{#1 has more than one page}\\fi\n"
+            "  \\setbox0=\\hbox{\\pdfrefximage\\pdflastximage}%\n"
+            "  \\pdfpagewidth=\\wd0 \\pdfpageheight=\\ht0 \\shipout\\box0}\n");
+    for (const auto &unitName : qAsConst(unitNames))
+        assemblyCode += QLatin1String("\\ktikzinclude{") + unitName + QLatin1String("}\n");
+    assemblyCode += QLatin1String("\\bye\n");
+    const QString assemblyFileName = QLatin1String("ktikzassembly.tex");
+    QFile assemblyFile(workingDir + QLatin1Char('/') + assemblyFileName);
+    if (!assemblyFile.open(QIODevice::WriteOnly)) {
+        showFileWriteError(assemblyFile.fileName(), assemblyFile.errorString());
+        return false;
+    }
+    assemblyFile.write(assemblyCode.toUtf8());
+    assemblyFile.close();
+
+    QString pdftexCommand = latexCommand;
+    pdftexCommand.replace(pdftexCommand.lastIndexOf(QLatin1String("pdflatex")), 8,
+                          QLatin1String("pdftex"));
+    QStringList arguments;
+    arguments << QLatin1String("-halt-on-error") << QLatin1String("-interaction")
+              << QLatin1String("nonstopmode")
+              << QLatin1String("-jobname=") + QFileInfo(tikzFileBaseName).fileName()
+              << assemblyFileName;
+    if (!runProcess(QLatin1String("pdfTeX"), pdftexCommand, arguments, workingDir)) {
+        if (isCancelled())
+            return false;
+        *logFileBaseName = tikzFileBaseName;
+        return generatePdfFile(tikzFileBaseName, latexCommand, useShellEscaping, formatFile);
+    }
+    Q_EMIT appendLog(QLatin1String("\n[LaTeX] ")
+                             + tr("%1 of %2 pictures compiled.", "info process")
+                                       .arg(compiledCount)
+                                       .arg(unitNames.size()),
+                     false);
+
+    // remove the pictures which are neither in this nor in the previous
+    // version of the TikZ code, so that undoing the last edit is still fast
+    const QStringList unitFileNames = QDir(workingDir).entryList(
+            QStringList() << QLatin1String("ktikzunit-*"), QDir::Files);
+    for (const auto &unitFileName : unitFileNames) {
+        const QString unitName = QFileInfo(unitFileName).baseName();
+        if (!unitNames.contains(unitName) && !m_previousTikzUnitNames.contains(unitName))
+            QFile::remove(workingDir + QLatin1Char('/') + unitFileName);
+    }
+    m_previousTikzUnitNames = unitNames;
+    return true;
+}
+
+/*!
+ * Starts a LaTeX process which loads the format and processes the body of
+ * the template up to the point where the TikZ code is input.  The next call
+ * to generatePdfFile() only has to wake it up, so that the startup of LaTeX
+ * and the loading of the format are not on the critical path.
+ */
+
+void TikzPreviewGenerator::startResidentWorker(const QString &tikzFileBaseName,
+                                               const QString &latexCommand,
+                                               bool useShellEscaping, const QString &formatFile)
+{
+    stopResidentWorker();
+
+    QStringList arguments = latexArguments(latexCommand, useShellEscaping, formatFile);
+    const QString workingDir = QFileInfo(tikzFileBaseName).absolutePath();
+    const QString key = latexCommand + arguments.join(QLatin1Char(' ')) + workingDir;
+    const QFileInfo tikzFileInfo(tikzFileBaseName);
+    arguments << QLatin1String("-jobname=") + tikzFileInfo.fileName()
+              << QLatin1String("\\def\\ktikzworker{}\\input{") + tikzFileInfo.fileName()
+                    + QLatin1String(".tex}");
+
+    // the worker counts as a running process; it is only started if a slot
+    // is free and gives its slot back when another request needs it
+    if (!TikzCompileScheduler::instance()->tryAcquire())
+        return;
+    // the worker reads the .aux file right away and then truncates it
+    const QByteArray positionMarks = auxPositionMarks(tikzFileBaseName + QLatin1String(".aux"));
+    TikzProcess *worker = new TikzProcess;
+    worker->setWorkingDirectory(workingDir);
+    worker->setProcessEnvironment(m_jobSettings->processEnvironment);
+    worker->setResourceLimits(m_jobSettings->cpuTimeLimit, m_jobSettings->memoryLimit);
+    worker->start(latexCommand, arguments);
+    if (!worker->waitForStarted(1000)) {
+        delete worker;
+        TikzCompileScheduler::instance()->release();
+        return;
+    }
+
+    m_memberLock.lock();
+    m_workerProcess = worker;
+    m_workerKey = key;
+    m_workerPositionMarks = positionMarks;
+    m_memberLock.unlock();
+    TikzCompileScheduler::instance()->setIdle(this, "stopResidentWorker");
+}
+
+void TikzPreviewGenerator::stopResidentWorker()
+{
+    m_memberLock.lock();
+    TikzProcess *worker = m_workerProcess;
+    m_workerProcess = 0;
+    m_memberLock.unlock();
+
+    if (worker) {
+        TikzCompileScheduler::instance()->setBusy(this);
+        worker->killProcessGroup();
+        worker->waitForFinished(1000);
+        delete worker;
+        TikzCompileScheduler::instance()->release();
+    }
 }
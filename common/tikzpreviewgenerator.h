@@ -23,13 +23,19 @@
 #ifndef KTIKZ_TIKZPREVIEWGENERATOR_H
 #define KTIKZ_TIKZPREVIEWGENERATOR_H
 
+#include <QtCore/QAtomicInt>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QObject>
 #include <QtCore/QMutex>
 #include <QtCore/QProcessEnvironment>
 #include <QtCore/QThread>
 
+#include <atomic>
+#include <memory>
+
+#include "tikzpicturemetrics.h"
+
 class QPixmap;
-class QProcess;
 class QPlainEdit;
 class QTextStream;
 
@@ -37,7 +43,12 @@ namespace Poppler {
 class Document;
 }
 
+class TikzCompileCache;
+class TikzFormatCache;
+class TikzGnuplotCache;
 class TikzPreviewController;
+class TikzProcess;
+class TextCodecProfile;
 
 /**
  * @author Florian Hackenberger <florian@hackenberger.at>
@@ -49,19 +60,41 @@ class TikzPreviewGenerator : public QObject
 
 public:
     enum TemplateStatus { DontReloadTemplate = 0, ReloadTemplate = 1 };
+    enum PreviewEngine { PdfEngine = 0, FastPreviewEngine = 1 };
 
     explicit TikzPreviewGenerator(TikzPreviewController *parent);
     ~TikzPreviewGenerator();
 
+    void setTikzCode(const QString &tikzCode);
     void setTikzFileBaseName(const QString &name);
     void setLatexCommand(const QString &command);
     void setPdftopsCommand(const QString &command);
+    void setDvisvgmCommand(const QString &command);
+    void setPreviewEngine(PreviewEngine engine);
     void setShellEscaping(bool useShellEscaping);
+    void setUsePreambleFormat(bool usePreambleFormat);
+    void setUseResidentWorker(bool useResidentWorker);
+    void setUseIncrementalCompilation(bool useIncrementalCompilation);
+    void setUseCompileCache(bool useCompileCache);
+    void setCompileCacheSize(qint64 size);
+    void setAbortOnFirstError(bool abortOnFirstError);
+    void setUseDraftPreCheck(bool useDraftPreCheck);
+    void setResourceLimits(int cpuTimeLimit, int memoryLimit, int timeLimit);
+    void setForeground(bool isForeground);
+    void setCompileTimeEstimate(qreal compileTimeEstimate);
+    void setFinishFraction(qreal finishFraction);
+    int completedJobCount() const;
+    int abortedJobCount() const;
+    int coalescedJobCount() const;
     QString getLogText() const;
-    bool hasRunFailed();
-    void addToLatexSearchPath(const QString &path);
+    bool hasRunFailed() const;
+    bool addToLatexSearchPath(const QString &path);
     void removeFromLatexSearchPath(const QString &path);
-    bool generateEpsFile(int page);
+    bool writePdfFile(const QString &fileName) const;
+    bool generateEpsFile(int page, const QString &epsFileName);
+    bool generateEpsFiles(const QList<int> &pages, const QStringList &epsFileNames);
+    QString createSlot(const QString &purpose);
+    void releaseSlot(const QString &slotDir);
 
 public Q_SLOTS:
     void setTemplateFile(const QString &fileName);
@@ -71,48 +104,143 @@ public Q_SLOTS:
 
 Q_SIGNALS:
     void pixmapUpdated(Poppler::Document *tikzPdfDoc,
-                       const QList<qreal> &tikzCoordinates = QList<qreal>());
+                       const QVector<TikzPictureMetrics> &tikzPictureMetrics =
+                               QVector<TikzPictureMetrics>());
+    void svgUpdated(const QList<QByteArray> &svgPages,
+                    const QVector<TikzPictureMetrics> &tikzPictureMetrics);
     void setExportActionsEnabled(bool enabled);
     void showErrorMessage(const QString &message);
     void updateLog(const QString &logText, bool runFailed);
     void appendLog(const QString &logText, bool runFailed);
     void processRunning(bool isRunning);
+    void compilationFinished(int elapsedTime);
+    void previewFinished(bool success);
+    void dependenciesChanged(const QStringList &dependencies);
 
 private Q_SLOTS:
-    void generatePreviewImpl(TemplateStatus templateStatus = DontReloadTemplate);
+    void generatePreviewImpl(int request);
+    void stopResidentWorker();
 
 protected:
-    void parseLogFile();
-    void createPreview();
+    // the configuration of the generator; a published snapshot is never
+    // modified, so it can be read in any thread without locking
+    struct Settings
+    {
+        Settings();
+
+        QString latexCommand;
+        QString pdftopsCommand;
+        QString dvisvgmCommand;
+        PreviewEngine previewEngine;
+        bool useShellEscaping;
+        bool usePreambleFormat;
+        bool useResidentWorker;
+        bool useIncrementalCompilation;
+        bool useCompileCache;
+        qint64 compileCacheSize; // in bytes
+        bool abortOnFirstError;
+        bool useDraftPreCheck;
+        int cpuTimeLimit; // in seconds, 0 if unlimited
+        int memoryLimit; // in MiB, 0 if unlimited
+        int timeLimit; // wall-clock time in seconds, 0 if unlimited
+        QProcessEnvironment processEnvironment;
+        QString templateFileName;
+        QString tikzReplaceText;
+    };
+
+    std::shared_ptr<const Settings> settings() const;
+    std::shared_ptr<Settings> copySettings() const;
+    void publishSettings(const std::shared_ptr<const Settings> &settings);
+    void parseLogFile(const QString &tikzFileBaseName);
+    bool createPreview();
+    bool reloadTemplate();
+    void removeTemplateDependentFiles();
+    const TextCodecProfile *textCodecProfile() const;
     void showFileWriteError(const QString &fileName, const QString &errorMessage);
+    bool writeLatexFile(const QString &latexCode);
     bool runProcess(const QString &name, const QString &command, const QStringList &arguments,
-                    const QString &workingDir = QString());
+                    const QString &workingDir = QString(),
+                    TikzProcess *startedProcess = 0);
     bool generatePdfFile(const QString &tikzFileBaseName, const QString &latexCommand,
-                         bool useShellEscaping);
+                         bool useShellEscaping, const QString &formatFile = QString(),
+                         const QString &jobName = QString());
+    bool runLatexPass(const QString &tikzFileBaseName, const QString &latexCommand,
+                      bool useShellEscaping, const QString &formatFile, const QString &jobName,
+                      QByteArray *readPositionMarks);
+    bool runDraftPreCheck(const QString &tikzFileBaseName, const QString &latexCommand,
+                          bool useShellEscaping, const QString &formatFile,
+                          qint64 *elapsedTime);
+    bool generateSvgFiles(const QString &tikzFileBaseName, const QString &latexCommand,
+                          bool useShellEscaping);
+    bool generateIncrementalPdfFile(const QStringList &tikzPictureCodes,
+                                    const QString &formatFile, QString *logFileBaseName);
+    void startResidentWorker(const QString &tikzFileBaseName, const QString &latexCommand,
+                             bool useShellEscaping, const QString &formatFile);
+    bool isNearlyFinished() const;
+    qint64 compileTime() const;
+    bool isCancelled() const;
+    void cancelRequests(int lastCancelledRequest);
+    void removeStaleSlots();
+    QStringList recorderFileNames(bool incremental) const;
+    bool updateDependencies(bool incremental);
+    bool scanLatexOutput(const QByteArray &output, int *scannedSize);
 
     TikzPreviewController *m_parent;
     Poppler::Document *m_tikzPdfDoc;
+    QByteArray m_tikzPdfData; // must remain valid as long as m_tikzPdfDoc exists
+    QVector<TikzPictureMetrics> m_tikzPictureMetrics; // one for each page of m_tikzPdfDoc
     QString m_tikzCode;
+    QString m_sourceTikzCode; // the TikZ code to compile when there is no controller
 
     QThread m_thread;
 
-    QProcess *m_process;
+    TikzProcess *m_process;
     mutable QMutex m_memberLock;
     bool m_processAborted;
-    bool m_runFailed;
-    QProcessEnvironment m_processEnvironment;
+    bool m_processCrashed;
+    QAtomicInt m_waitCancelled; // set when aborting while waiting for the compile scheduler
+    QAtomicInt m_isForeground; // read by runProcess() without locking m_memberLock
+    TikzProcess *m_workerProcess; // resident LaTeX process waiting for the next TikZ code
+    QString m_workerKey;
+    QByteArray m_workerPositionMarks; // the positions in the .aux file read by the worker
+    bool m_generating; // the following are only used in m_thread
+    bool m_hasPendingRequest;
+    QAtomicInt m_latestRequest; // only the latest request is handled, older ones are dropped
+    QAtomicInt m_generation; // the request which is being handled
+    QAtomicInt m_cancelledRequest; // this request and all older ones are cancelled
+    QAtomicInt m_reloadRequested;
+    QAtomicInt m_completedJobCount;
+    QAtomicInt m_abortedJobCount;
+    QAtomicInt m_coalescedJobCount;
+    // read by isNearlyFinished() in the main thread without locking m_memberLock
+    QElapsedTimer m_clock; // started in the constructor, only read afterwards
+    std::atomic<qint64> m_compileStartTime; // on m_clock, negative if not compiling
+    std::atomic<qreal> m_compileTimeEstimate; // in msec, negative if unknown
+    std::atomic<qreal> m_finishFraction; // a run this far is not aborted, negative to always abort
+    QAtomicInt m_runFailed; // read by hasRunFailed() without locking m_memberLock
+    bool m_firstErrorShown; // an error has been found in the output of the running process
+    bool m_stoppedAtFirstError;
+    bool m_limitExceeded; // the last process has been killed because it exceeded its limits
     bool m_firstRun;
 
+    std::shared_ptr<const Settings> m_settings; // only accessed with std::atomic_load/store
+    std::shared_ptr<const Settings> m_jobSettings; // taken at the start of each job in m_thread
+
     QString m_tikzFileBaseName;
-    QString m_templateFileName;
-    QString m_tikzReplaceText;
     bool m_templateChanged;
+    QString m_latexCode; // the template in which the TikZ code is input
+    QByteArray m_latexCodeHash;
+    QByteArray m_templateStamp; // identifies the template file and replace text of m_latexCode
+    QString m_writtenLatexCode; // the LaTeX code currently in the .tex file
+
+    TikzFormatCache *m_formatCache;
+    QStringList m_previousTikzUnitNames;
+    QStringList m_dependencies; // files read by LaTeX besides the template and the TikZ code
+    TikzCompileCache *m_compileCache;
+    TikzGnuplotCache *m_gnuplotCache;
 
-    QString m_latexCommand;
-    QString m_pdftopsCommand;
     QString m_shortLogText;
     QString m_logText;
-    bool m_useShellEscaping;
 };
 
 #endif
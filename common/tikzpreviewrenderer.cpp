@@ -18,7 +18,10 @@
 
 #include "tikzpreviewrenderer.h"
 
+#include <QtCore/QtMath>
 #include <QtGui/QImage>
+#include <QtGui/QPainter>
+#include <QtSvg/QSvgRenderer>
 #include <poppler-qt5.h>
 
 TikzPreviewRenderer::TikzPreviewRenderer()
@@ -35,12 +38,65 @@ TikzPreviewRenderer::~TikzPreviewRenderer()
     }
 }
 
+/*!
+ * Returns the number of a new render request.  The requests which are
+ * queued before it are skipped and the images which are still being
+ * rendered for them are dropped.  This function is thread-safe.
+ */
+
+int TikzPreviewRenderer::nextRequest()
+{
+    return m_latestRequest.fetchAndAddOrdered(1) + 1;
+}
+
+bool TikzPreviewRenderer::isLatestRequest(int request) const
+{
+    return request == m_latestRequest.loadAcquire();
+}
+
 void TikzPreviewRenderer::generatePreview(Poppler::Document *tikzPdfDoc, qreal zoomFactor,
-                                          int currentPage)
+                                          int currentPage, int request)
 {
+    // the document may already have been replaced by a newer one
+    if (!isLatestRequest(request))
+        return;
+
     Poppler::Page *pdfPage = tikzPdfDoc->page(currentPage);
     const QImage tikzImage = pdfPage->renderToImage(zoomFactor * 72, zoomFactor * 72);
     delete pdfPage;
 
-    Q_EMIT showPreview(tikzImage, zoomFactor);
+    if (isLatestRequest(request))
+        Q_EMIT showPreview(tikzImage, zoomFactor, request);
+}
+
+/*!
+ * Renders a page of the fast preview, which dvisvgm has converted to SVG.
+ * The view box of the SVG data is measured in PostScript points, so the
+ * image has the same size as the rendering of the corresponding PDF page.
+ */
+
+QImage TikzPreviewRenderer::renderSvgToImage(const QByteArray &svgData, double xres, double yres)
+{
+    QSvgRenderer svgRenderer(svgData);
+    if (!svgRenderer.isValid())
+        return QImage();
+    const QSizeF size = svgRenderer.viewBoxF().size();
+    QImage image(qCeil(size.width() * xres / 72), qCeil(size.height() * yres / 72),
+                 QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::white);
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    svgRenderer.render(&painter);
+    return image;
+}
+
+void TikzPreviewRenderer::generateSvgPreview(const QByteArray &svgData, qreal zoomFactor,
+                                             int request)
+{
+    if (!isLatestRequest(request))
+        return;
+
+    const QImage tikzImage = renderSvgToImage(svgData, zoomFactor * 72, zoomFactor * 72);
+    if (isLatestRequest(request))
+        Q_EMIT showPreview(tikzImage, zoomFactor, request);
 }
@@ -19,6 +19,7 @@
 #ifndef KTIKZ_TIKZPREVIEWRENDERER_H
 #define KTIKZ_TIKZPREVIEWRENDERER_H
 
+#include <QtCore/QAtomicInt>
 #include <QtCore/QThread>
 
 class QImage;
@@ -35,15 +36,21 @@ public:
     TikzPreviewRenderer();
     ~TikzPreviewRenderer();
 
+    static QImage renderSvgToImage(const QByteArray &svgData, double xres, double yres);
+    int nextRequest();
+    bool isLatestRequest(int request) const;
+
 public Q_SLOTS:
-    void generatePreview(Poppler::Document *tikzPdfDoc, qreal zoomFactor = 1.0,
-                         int currentPage = 0);
+    void generatePreview(Poppler::Document *tikzPdfDoc, qreal zoomFactor, int currentPage,
+                         int request);
+    void generateSvgPreview(const QByteArray &svgData, qreal zoomFactor, int request);
 
 Q_SIGNALS:
-    void showPreview(const QImage &image, qreal zoomFactor = 1.0);
+    void showPreview(const QImage &image, qreal zoomFactor, int request);
 
 private:
     QThread m_thread;
+    QAtomicInt m_latestRequest; // older requests are not rendered or shown anymore
 };
 
 #endif
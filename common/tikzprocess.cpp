@@ -0,0 +1,86 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#include "tikzprocess.h"
+
+#ifdef Q_OS_UNIX
+#  include <signal.h>
+#  include <sys/resource.h>
+#  include <unistd.h>
+#endif
+
+TikzProcess::TikzProcess(QObject *parent)
+    : QProcess(parent), m_lowPriority(false), m_cpuTimeLimit(0), m_memoryLimit(0)
+{
+}
+
+void TikzProcess::setLowPriority(bool lowPriority)
+{
+    m_lowPriority = lowPriority;
+}
+
+/*!
+ * Limits the CPU time of the process to \p cpuTimeLimit seconds and its
+ * address space to \p memoryLimit MiB; a value of 0 means no limit.  The
+ * limits are inherited by the programs started by the process.
+ */
+
+void TikzProcess::setResourceLimits(int cpuTimeLimit, int memoryLimit)
+{
+    m_cpuTimeLimit = qMax(0, cpuTimeLimit);
+    m_memoryLimit = qMax(0, memoryLimit);
+}
+
+/*!
+ * Kills the process and all processes in its process group.
+ */
+
+void TikzProcess::killProcessGroup()
+{
+#ifdef Q_OS_UNIX
+    const qint64 pid = processId();
+    if (pid > 0)
+        ::kill(-pid_t(pid), SIGKILL);
+#endif
+    kill();
+}
+
+/*!
+ * Runs in the child process between fork() and exec(), so only
+ * async-signal-safe functions may be called here.
+ */
+
+void TikzProcess::setupChildProcess()
+{
+#ifdef Q_OS_UNIX
+    ::setpgid(0, 0);
+    if (m_lowPriority)
+        (void)::nice(10);
+    struct rlimit limit;
+    if (m_cpuTimeLimit > 0) {
+        // SIGXCPU is sent at the soft limit, SIGKILL at the hard limit
+        limit.rlim_cur = rlim_t(m_cpuTimeLimit);
+        limit.rlim_max = rlim_t(m_cpuTimeLimit) + 1;
+        ::setrlimit(RLIMIT_CPU, &limit);
+    }
+    if (m_memoryLimit > 0) {
+        limit.rlim_cur = rlim_t(m_memoryLimit) * 1024 * 1024;
+        limit.rlim_max = limit.rlim_cur;
+        ::setrlimit(RLIMIT_AS, &limit);
+    }
+#endif
+}
@@ -0,0 +1,50 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the KtikZ developers                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>.  *
+ ***************************************************************************/
+
+#ifndef KTIKZ_TIKZPROCESS_H
+#define KTIKZ_TIKZPROCESS_H
+
+#include <QtCore/QProcess>
+
+/**
+ * A process which can be started with a lower scheduling priority, so that
+ * the LaTeX runs of windows in the background do not slow down the run of
+ * the window in which the user is working.  The process is started in its
+ * own process group with optional limits on its CPU time and memory, so that
+ * it can be killed together with the programs it started (e.g. gnuplot).
+ */
+class TikzProcess : public QProcess
+{
+    Q_OBJECT
+
+public:
+    explicit TikzProcess(QObject *parent = 0);
+
+    void setLowPriority(bool lowPriority);
+    void setResourceLimits(int cpuTimeLimit, int memoryLimit);
+    void killProcessGroup();
+
+protected:
+    void setupChildProcess() override;
+
+private:
+    bool m_lowPriority;
+    int m_cpuTimeLimit; // in seconds, 0 if unlimited
+    int m_memoryLimit; // in MiB, 0 if unlimited
+};
+
+#endif
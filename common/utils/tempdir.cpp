@@ -18,7 +18,7 @@
 
 #include "tempdir.h"
 
-#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
 
 // #include <KStandardDirs>
 #include <QTemporaryDir>
@@ -37,26 +37,21 @@ const QString TempDir::location() const
 }
 
 /*!
- * Removes all files in the temporary directory.
+ * Returns a template path for a temporary directory on a file system which
+ * is kept in memory (tmpfs), or an empty string if no such file system is
+ * known to be available.
  */
 
-bool TempDir::cleanUp()
+QString TempDir::memoryBackedTemplatePath()
 {
-    const QString dirName = path();
-    if (dirName.isEmpty()) // we must return in this case, otherwise in the QDir constructor below,
-                           // the program's working directory is used and we really don't want to
-                           // remove the files in that
-        return false;
-
-    QDir tempDir(dirName);
-    if (!tempDir.exists())
-        return false;
-
-    bool success = true;
-    const QStringList fileList = tempDir.entryList(QDir::NoDotAndDotDot | QDir::AllEntries);
-    for (const auto &fileName : fileList) {
-        success = success && tempDir.remove(fileName);
+#ifdef Q_OS_LINUX
+    QStringList locations;
+    locations << QLatin1String("/dev/shm") << QString::fromLocal8Bit(qgetenv("XDG_RUNTIME_DIR"));
+    for (const auto &location : qAsConst(locations)) {
+        const QFileInfo locationInfo(location);
+        if (!location.isEmpty() && locationInfo.isDir() && locationInfo.isWritable())
+            return location + QLatin1String("/ktikz-XXXXXX");
     }
-
-    return success;
+#endif
+    return QString();
 }
@@ -27,7 +27,8 @@ public:
     explicit TempDir(const QString &directoryPrefix = QString());
 
     const QString location() const;
-    bool cleanUp();
+
+    static QString memoryBackedTemplatePath();
 };
 
 #endif